@@ -0,0 +1,359 @@
+/**
+ *
+ *           @name  batch_pdf.h
+ *          @brief  PDFs evaluated over arrays of points, with the parameter-dependent
+ *          constants computed once.
+ *
+ *          A `TF1` callback `double f( double *x, double *p )` is called once per point
+ *          and has to recompute everything that depends only on the parameters (the
+ *          normalization, \f$1/\sigma\f$, \f$\cos\phi\f$ and \f$\sin\phi\f$ in
+ *          `my2DGaussRot()`, \f$\ln\Gamma(n/2)\f$ in `ChiSquarePDF()`, ...). Here each PDF is a
+ *          small class: the constructor takes the parameters and computes those constants,
+ *          `evaluate()` loops over contiguous arrays of points with `omp simd`.
+ *
+ *          Every PDF has the same interface:
+ *          @code
+ *          	static const int nPars;               // number of parameters
+ *          	Pdf ( const double *p );              // same order as the TF1 parameters
+ *          	double operator() ( const double *x ) const;
+ *          	void evaluate ( const double *x, double *f, size_t n ) const; // 1D
+ *          @endcode
+ *          on which are built
+ *          - `integrate()`: Simpson's rule, the points evaluated by batches;
+ *          - `PdfSampler` and `sample()`: inverse of the tabulated distribution
+ *            function, with the uniforms of `philox.h`;
+ *          - `logLikelihood()`: \f$\sum_i \ln f(x_i)\f$ by batches;
+ *          - `TF1Adapter`: a functor for `TF1`/`TF2` which rebuilds the PDF only when the
+ *            parameters change, so drawing and fitting code keeps working.
+ *
+ *          Example:
+ *          @code
+ *          	TF1 *f = new TF1( "f", TF1Adapter<GaussPdf>(), -5, 5, GaussPdf::nPars );
+ *          	f->SetParameters( 0., 1., 1. );
+ *          	const double p = integrate( GaussPdf( 5., 1. ), 9.2, 30. );
+ *          @endcode
+ *
+ */
+
+#ifndef  batch_pdf_INC
+#define  batch_pdf_INC
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "philox.h"
+
+/// Points per batch in `integrate()`, `sample()` and `logLikelihood()`.
+const size_t pdfBatchSize = 4096;
+
+/**
+ * @brief Gaussian \f$N\,\mathrm{e}^{-(x-\mu)^2\!/2\sigma^2}/\sqrt{2\pi}\sigma\f$.
+ *
+ * Parameters: \f$(\mu, \sigma, N)\f$.
+ */
+class GaussPdf {
+	public:
+		static const int nPars = 3;
+
+		GaussPdf ( double mean, double sigma, double norm = 1. ) { set( mean, sigma, norm ); }
+		GaussPdf ( const double *p ) { set( p[0], p[1], p[2] ); }
+
+		double
+		operator() ( const double *x ) const {
+			const double z = ( x[0] - mean_ ) * invSigma_;
+			return norm_ * std::exp( -.5 * z * z );
+		}
+
+		void
+		evaluate ( const double *x, double *f, size_t n ) const {
+			const double mean = mean_, invSigma = invSigma_, norm = norm_;
+
+			#pragma omp simd
+			for ( size_t j = 0; j < n; ++ j ) {
+				const double z = ( x[j] - mean ) * invSigma;
+				f[j] = norm * std::exp( -.5 * z * z );
+			}
+		}
+
+	private:
+		void
+		set ( double mean, double sigma, double norm ) {
+			mean_ = mean;
+			invSigma_ = 1. / sigma;
+			norm_ = norm / ( std::sqrt( 2. * M_PI ) * sigma );
+		}
+
+		double mean_, invSigma_, norm_;
+};
+
+/**
+ * @brief 2D Gaussian rotated by \f$\phi\f$ around its mean, as `my2DGaussRot()`.
+ *
+ * Parameters: \f$(\langle x\rangle, \sigma_x, \langle y\rangle, \sigma_y, \phi)\f$, with
+ * \f$\phi\f$ in radians; \f$\cos\phi\f$ and \f$\sin\phi\f$ are evaluated once.
+ */
+class Gauss2DPdf {
+	public:
+		static const int nPars = 5;
+
+		Gauss2DPdf ( double meanX, double sigmaX, double meanY, double sigmaY, double phi = 0. ) {
+			set( meanX, sigmaX, meanY, sigmaY, phi );
+		}
+		Gauss2DPdf ( const double *p ) { set( p[0], p[1], p[2], p[3], p[4] ); }
+
+		double
+		operator() ( const double *x ) const {
+			return eval( x[0], x[1] );
+		}
+
+		/** @brief `f[j]` at the point `(x[j], y[j])`. */
+		void
+		evaluate ( const double *x, const double *y, double *f, size_t n ) const {
+			#pragma omp simd
+			for ( size_t j = 0; j < n; ++ j )
+				f[j] = eval( x[j], y[j] );
+		}
+
+	private:
+		void
+		set ( double meanX, double sigmaX, double meanY, double sigmaY, double phi ) {
+			meanX_ = meanX;
+			meanY_ = meanY;
+			// the rotation and the widths are folded into one matrix
+			cx_ = std::cos( phi ) / sigmaX;
+			sx_ = std::sin( phi ) / sigmaX;
+			cy_ = std::cos( phi ) / sigmaY;
+			sy_ = std::sin( phi ) / sigmaY;
+			norm_ = 1. / ( 2. * M_PI * sigmaX * sigmaY );
+		}
+
+		double
+		eval ( double x, double y ) const {
+			const double dx = x - meanX_;
+			const double dy = y - meanY_;
+			const double u = dx * cx_ - dy * sx_;
+			const double v = dy * cy_ + dx * sy_;
+			return norm_ * std::exp( -.5 * ( u * u + v * v ) );
+		}
+
+		double meanX_, meanY_;
+		double cx_, sx_, cy_, sy_; //!< \f$\cos\phi/\sigma\f$ and \f$\sin\phi/\sigma\f$.
+		double norm_;
+};
+
+/**
+ * @brief \f$\chi^2\f$-distribution with \f$n\f$ degrees of freedom.
+ *
+ * \f[
+ *     f(x; n) = \frac{x^{n/2-1}\,\mathrm{e}^{-x/2}}{2^{n/2}\,\Gamma(n/2)},
+ * \f]
+ * evaluated as an exponential with \f$\ln\Gamma(n/2)\f$ computed once.
+ * Parameters: \f$(n)\f$.
+ */
+class ChiSquarePdf {
+	public:
+		static const int nPars = 1;
+
+		ChiSquarePdf ( double ndf ) { set( ndf ); }
+		ChiSquarePdf ( const double *p ) { set( p[0] ); }
+
+		double
+		operator() ( const double *x ) const {
+			return ( x[0] > 0. ) ? std::exp( power_ * std::log( x[0] ) - .5 * x[0] + logNorm_ ) : 0.;
+		}
+
+		void
+		evaluate ( const double *x, double *f, size_t n ) const {
+			const double power = power_, logNorm = logNorm_;
+
+			#pragma omp simd
+			for ( size_t j = 0; j < n; ++ j )
+				f[j] = ( x[j] > 0. ) ? std::exp( power * std::log( x[j] ) - .5 * x[j] + logNorm ) : 0.;
+		}
+
+	private:
+		void
+		set ( double ndf ) {
+			power_ = .5 * ndf - 1.;
+			logNorm_ = - .5 * ndf * std::log( 2. ) - std::lgamma( .5 * ndf );
+		}
+
+		double power_;   //!< \f$n/2 - 1\f$.
+		double logNorm_; //!< \f$-\ln\left(2^{n/2}\Gamma(n/2)\right)\f$.
+};
+
+/**
+ * @brief Exponential decay \f$N\,\mathrm{e}^{-t/\tau}/\tau\f$, as `decayPDF()`.
+ *
+ * Parameters: \f$(\tau, N)\f$.
+ */
+class DecayPdf {
+	public:
+		static const int nPars = 2;
+
+		DecayPdf ( double tau, double norm = 1. ) { set( tau, norm ); }
+		DecayPdf ( const double *p ) { set( p[0], p[1] ); }
+
+		double
+		operator() ( const double *x ) const {
+			return norm_ * std::exp( - x[0] * invTau_ );
+		}
+
+		void
+		evaluate ( const double *x, double *f, size_t n ) const {
+			const double invTau = invTau_, norm = norm_;
+
+			#pragma omp simd
+			for ( size_t j = 0; j < n; ++ j )
+				f[j] = norm * std::exp( - x[j] * invTau );
+		}
+
+	private:
+		void
+		set ( double tau, double norm ) {
+			invTau_ = 1. / tau;
+			norm_ = norm / tau;
+		}
+
+		double invTau_, norm_;
+};
+
+/**
+ * @brief Functor for `TF1` and `TF2`.
+ *
+ * The PDF is rebuilt only when the parameters differ from those of the previous call,
+ * which is once per drawing and once per step of a fit.
+ *
+ * @attention The last parameters and PDF are cached in the functor, with no locking:
+ * a functor (i.e. the `TF1` holding its copy) must be evaluated by one thread at a
+ * time. Parallel fits are fine as long as each thread has its own `TF1`, as the toys
+ * of `toy_study.h` do.
+ */
+template <class Pdf>
+class TF1Adapter {
+	public:
+		TF1Adapter () : pars_( Pdf::nPars, 0. ), pdf_( &pars_[0] ), valid_( false ) {}
+
+		double
+		operator() ( const double *x, const double *p ) const {
+			if ( ! valid_ || ! std::equal( pars_.begin(), pars_.end(), p ) ) {
+				pars_.assign( p, p + Pdf::nPars );
+				pdf_ = Pdf( p );
+				valid_ = true;
+			}
+			return pdf_( x );
+		}
+
+	private:
+		mutable std::vector<double> pars_;
+		mutable Pdf pdf_;
+		mutable bool valid_;
+};
+
+/**
+ * @brief \f$\int_a^b f(x)\,\mathrm{d}x\f$ by Simpson's rule over `intervals` intervals.
+ *
+ * `intervals` is rounded up to an even number.
+ */
+template <class Pdf>
+	double
+integrate ( const Pdf &pdf, double a, double b, size_t intervals = 10000 ) {
+	intervals += intervals & 1;
+	const double h = ( b - a ) / intervals;
+
+	std::vector<double> x( pdfBatchSize ), f( pdfBatchSize );
+	double sum = 0.;
+	for ( size_t first = 0; first <= intervals; first += pdfBatchSize ) {
+		const size_t n = std::min( pdfBatchSize, intervals + 1 - first );
+		for ( size_t j = 0; j < n; ++ j )
+			x[j] = a + ( first + j ) * h;
+		pdf.evaluate( &x[0], &f[0], n );
+
+		// weights 1, 4, 2, 4, ..., 2, 4, 1
+		for ( size_t j = 0; j < n; ++ j ) {
+			const size_t k = first + j;
+			sum += f[j] * ( ( k == 0 || k == intervals ) ? 1. : ( ( k & 1 ) ? 4. : 2. ) );
+		}
+	}
+
+	return sum * h / 3.;
+}
+
+/**
+ * @brief \f$\sum_i \ln f(x_i)\f$ over `n` points.
+ */
+template <class Pdf>
+	double
+logLikelihood ( const Pdf &pdf, const double *x, size_t n ) {
+	std::vector<double> f( pdfBatchSize );
+	double sum = 0.;
+	for ( size_t first = 0; first < n; first += pdfBatchSize ) {
+		const size_t size = std::min( pdfBatchSize, n - first );
+		pdf.evaluate( x + first, &f[0], size );
+
+		#pragma omp simd reduction(+:sum)
+		for ( size_t j = 0; j < size; ++ j )
+			sum += std::log( f[j] );
+	}
+
+	return sum;
+}
+
+/**
+ * @brief Draw values in \f$[a, b]\f$ distributed as a PDF.
+ *
+ * As `TF1::GetRandom()`, the distribution function is tabulated over `bins` bins
+ * (trapezoids) and inverted by linear interpolation. The table is built once, by
+ * batches, and can be reused for any number of draws.
+ */
+class PdfSampler {
+	public:
+		template <class Pdf>
+		PdfSampler ( const Pdf &pdf, double a, double b, size_t bins = 1000 ) :
+			a_( a ), h_( ( b - a ) / bins ), cdf_( bins + 1 ) {
+			std::vector<double> x( bins + 1 ), f( bins + 1 );
+			for ( size_t k = 0; k <= bins; ++ k )
+				x[k] = a + k * h_;
+			pdf.evaluate( &x[0], &f[0], bins + 1 );
+
+			cdf_[0] = 0.;
+			for ( size_t k = 1; k <= bins; ++ k )
+				cdf_[k] = cdf_[k - 1] + .5 * h_ * ( f[k - 1] + f[k] );
+			for ( size_t k = 1; k <= bins; ++ k )
+				cdf_[k] /= cdf_[bins];
+		}
+
+		/**
+		 * @brief Draw `n` values into `out`.
+		 *
+		 * Value \f$j\f$ comes from uniform `first + j` of `rng`, so the result doesn't
+		 * depend on how the draws are split.
+		 */
+		void
+		sample ( double *out, size_t n, const PhiloxRandom &rng, uint64_t first = 0 ) const {
+			rng.fillUniform( out, n, first );
+			for ( size_t j = 0; j < n; ++ j ) {
+				const size_t k = std::upper_bound( cdf_.begin() + 1, cdf_.end() - 1, out[j] ) - cdf_.begin();
+				const double width = cdf_[k] - cdf_[k - 1];
+				out[j] = a_ + h_ * ( ( k - 1 ) + ( ( width > 0. ) ? ( out[j] - cdf_[k - 1] ) / width : .5 ) );
+			}
+		}
+
+	private:
+		double a_, h_;
+		std::vector<double> cdf_;
+};
+
+/**
+ * @brief Draw `n` values in \f$[a, b]\f$ distributed as `pdf` (see `PdfSampler`).
+ */
+template <class Pdf>
+	void
+sample ( const Pdf &pdf, double a, double b, double *out, size_t n, const PhiloxRandom &rng,
+		uint64_t first = 0, size_t bins = 1000 ) {
+	PdfSampler( pdf, a, b, bins ).sample( out, n, rng, first );
+}
+
+#endif   /* ----- #ifndef batch_pdf_INC  ----- */
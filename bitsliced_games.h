@@ -0,0 +1,368 @@
+/**
+ *
+ *           @name  bitsliced_games.h
+ *          @brief  Bit-sliced simulation of Penney's game (`penney_ante.C`) and of the
+ *          Monty Hall game (`monty_hall.C`).
+ *
+ *          A random 64-bit word is 64 coin tosses. Instead of drawing one toss at a time,
+ *          the games are played with bitwise operations on whole words.
+ *
+ *          *Penney's game.* Let toss \f$t\f$ be bit \f$t\f$ of the word \f$w\f$. The
+ *          3-toss window ending at \f$t\f$ matches the sequence \f$(s_2, s_1, s_0)\f$
+ *          (newest toss in \f$s_0\f$, as in `penney_ante.C`) if bit \f$t\f$ of
+ *          \f[
+ *              e_{s_2}(w \ll 2)\;\&\;e_{s_1}(w \ll 1)\;\&\;e_{s_0}(w),\qquad
+ *              e_1(x) = x,\quad e_0(x) = \bar x
+ *          \f]
+ *          is set, where the bits shifted in come from the previous word. This gives the
+ *          64 windows of the word at once for both sequences of a pair; each game then
+ *          ends at the lowest match past its start and the next game starts right after
+ *          it, with three fresh tosses.
+ *
+ *          The 8 pairs `(Choice, newSequence(Choice))` are 8 lanes: each lane has its
+ *          own generator and the generators and match masks of the lanes are stepped
+ *          together in `omp simd` loops.
+ *
+ *          *Monty Hall.* A door in \f$\{0,1,2\}\f$ is taken from two bits
+ *          \f$(a, b)\f$, rejecting \f$(1,1)\f$. For 64 trials at once, the valid trials
+ *          are \f$\overline{a\,\&\,b}\f$, the ones where the first choice is right are
+ *          \f$\overline{a\,|\,b}\f$ and they are counted with a popcount.
+ *
+ *          The generator is xoshiro256** (Blackman and Vigna). The games are split in
+ *          chunks of fixed size: chunk \f$c\f$ always gets the generators seeded with
+ *          `(seed, c, lane)` and chunks are handed out to the OpenMP threads, hence the
+ *          results don't depend on the number of threads.
+ *
+ */
+
+#ifndef  bitsliced_games_INC
+#define  bitsliced_games_INC
+
+#include <stdint.h>
+
+/// Games (or trials) per chunk.
+const unsigned long long bitslicedChunk = 1ULL << 20;
+
+/**
+ * @brief The _splitmix64_ generator, used to seed the lanes.
+ */
+	inline uint64_t
+splitmix64 ( uint64_t &x ) {
+	uint64_t z = ( x += 0x9e3779b97f4a7c15ULL );
+	z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+	z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+	return z ^ ( z >> 31 );
+}
+
+/**
+ * @brief `L` independent xoshiro256** generators stepped together.
+ */
+template <unsigned int L>
+class Xoshiro256Lanes {
+	public:
+		/** @brief Seed lane `l` from `(seed, stream, l)`. */
+		Xoshiro256Lanes ( uint64_t seed, uint64_t stream ) {
+			for ( unsigned int l = 0; l < L; ++ l ) {
+				uint64_t x = seed ^ splitmix64( stream ) ^ ( (uint64_t) l << 56 );
+				for ( unsigned int k = 0; k < 4; ++ k )
+					s_[k][l] = splitmix64( x );
+			}
+		}
+
+		/** @brief Next word of every lane. */
+		void
+		next ( uint64_t *word ) {
+			#pragma omp simd
+			for ( unsigned int l = 0; l < L; ++ l ) {
+				word[l] = rotl( s_[1][l] * 5, 7 ) * 9;
+
+				const uint64_t t = s_[1][l] << 17;
+				s_[2][l] ^= s_[0][l];
+				s_[3][l] ^= s_[1][l];
+				s_[1][l] ^= s_[2][l];
+				s_[0][l] ^= s_[3][l];
+				s_[2][l] ^= t;
+				s_[3][l] = rotl( s_[3][l], 45 );
+			}
+		}
+
+	private:
+		static uint64_t rotl ( uint64_t x, int k ) { return ( x << k ) | ( x >> ( 64 - k ) ); }
+
+		uint64_t s_[4][L];
+};
+
+/**
+ * @brief Index of the lowest set bit (`x` must not be 0).
+ */
+	inline int
+lowestBit ( uint64_t x ) {
+	return __builtin_ctzll( x );
+}
+
+/**
+ * @brief Number of set bits.
+ */
+	inline int
+popCount ( uint64_t x ) {
+	return __builtin_popcountll( x );
+}
+
+/**
+ * @brief The sequence \f$(\bar c_1, c_2, c_1)\f$ played against \f$(c_2, c_1, c_0)\f$.
+ *
+ * Same as `newSequence()` in `penney_ante_benchmark.C`.
+ */
+	inline unsigned int
+penneyResponse ( unsigned int choice ) {
+	return ( ( choice & 3 ) << 1 | ( choice & 2 ) >> 1 ) ^ 4;
+}
+
+/**
+ * @brief Windows of `w` matching the 3-toss `sequence`.
+ *
+ * @param previous the previous word, whose last two tosses start the windows
+ */
+	inline uint64_t
+penneyMatch ( uint64_t w, uint64_t previous, unsigned int sequence ) {
+	const uint64_t w1 = ( w << 1 ) | ( previous >> 63 );
+	const uint64_t w2 = ( w << 2 ) | ( previous >> 62 );
+
+	/// \f$e_s(x) = x \oplus (s - 1)\f$ is \f$x\f$ for \f$s = 1\f$ and \f$\bar x\f$ for \f$s = 0\f$.
+	return ( w2 ^ ( (uint64_t) ( sequence >> 2 & 1 ) - 1 ) )
+		& ( w1 ^ ( (uint64_t) ( sequence >> 1 & 1 ) - 1 ) )
+		& ( w ^ ( (uint64_t) ( sequence & 1 ) - 1 ) );
+}
+
+/**
+ * @brief Wins of Penney's game for the 8 pairs `(Choice, penneyResponse(Choice))`.
+ */
+struct PenneyResult {
+	PenneyResult () {
+		for ( unsigned int c = 0; c < 8; ++ c )
+			wins[c] = notWins[c] = 0;
+	}
+
+	unsigned long long wins[8];    //!< Wins of `Choice`.
+	unsigned long long notWins[8]; //!< Wins of `penneyResponse(Choice)`.
+};
+
+/**
+ * @brief Play `games` games in each of the 8 lanes with the generators of `chunk`.
+ */
+	inline void
+penneyChunk ( unsigned long long games, uint64_t seed, uint64_t chunk, PenneyResult &result ) {
+	Xoshiro256Lanes<8> rng( seed, chunk );
+
+	uint64_t word[8], previous[8] = {}, a[8], b[8];
+	unsigned int response[8];
+	unsigned long long left[8];
+	/// The first window of a game ends two tosses after its start.
+	unsigned int start[8];
+	for ( unsigned int c = 0; c < 8; ++ c ) {
+		response[c] = penneyResponse( c );
+		left[c] = games;
+		start[c] = 2;
+	}
+
+	unsigned int running = 8;
+	while ( running ) {
+		rng.next( word );
+
+		#pragma omp simd
+		for ( unsigned int c = 0; c < 8; ++ c ) {
+			a[c] = penneyMatch( word[c], previous[c], c );
+			b[c] = penneyMatch( word[c], previous[c], response[c] );
+			previous[c] = word[c];
+		}
+
+		for ( unsigned int c = 0; c < 8; ++ c ) {
+			if ( ! left[c] )
+				continue;
+
+			const uint64_t any = a[c] | b[c];
+			unsigned int s = start[c];
+			while ( s < 64 ) {
+				const uint64_t hits = any & ( ~0ULL << s );
+				if ( ! hits )
+					break;
+
+				// a sequence and its response can be the same: both win
+				const int t = lowestBit( hits );
+				result.wins[c] += a[c] >> t & 1;
+				result.notWins[c] += b[c] >> t & 1;
+
+				if ( ! -- left[c] ) {
+					-- running;
+					break;
+				}
+
+				/// The next game starts with three new tosses.
+				s = t + 3;
+			}
+
+			start[c] = ( s < 64 ) ? 0 : s - 64;
+		}
+	}
+}
+
+/**
+ * @brief Play `games` games of Penney's game for each `Choice`.
+ */
+	inline PenneyResult
+penneyAnte ( unsigned long long games, uint64_t seed ) {
+	PenneyResult result;
+	const long long chunks = ( games + bitslicedChunk - 1 ) / bitslicedChunk;
+
+	#pragma omp parallel
+	{
+		PenneyResult local;
+
+		#pragma omp for schedule(dynamic)
+		for ( long long chunk = 0; chunk < chunks; ++ chunk ) {
+			const unsigned long long first = chunk * bitslicedChunk;
+			const unsigned long long size = ( games - first < bitslicedChunk ) ? games - first : bitslicedChunk;
+			penneyChunk( size, seed, chunk, local );
+		}
+
+		#pragma omp critical(bitsliced_games)
+		for ( unsigned int c = 0; c < 8; ++ c ) {
+			result.wins[c] += local.wins[c];
+			result.notWins[c] += local.notWins[c];
+		}
+	}
+
+	return result;
+}
+
+/**
+ * @brief Wins of the two Monty Hall strategies.
+ */
+struct MontyHallResult {
+	MontyHallResult () : noChange( 0 ), change( 0 ) {}
+
+	unsigned long long noChange; //!< Wins keeping the first door.
+	unsigned long long change;   //!< Wins changing door.
+};
+
+/**
+ * @brief Keep only the lowest `n` set bits of `x`.
+ */
+	inline uint64_t
+lowestBits ( uint64_t x, int n ) {
+	uint64_t kept = 0;
+	for ( ; n > 0 && x; -- n ) {
+		kept |= x & ( ~x + 1 );
+		x &= x - 1;
+	}
+	return kept;
+}
+
+/**
+ * @brief Outcomes of the next trials of the two strategies.
+ *
+ * Each strategy draws its own doors, as in `monty_hall.C`.
+ */
+class MontyHallWords {
+	public:
+		MontyHallWords ( uint64_t seed, uint64_t stream ) : rng_( seed, stream ) {}
+
+		/**
+		 * @brief Next (about 48) trials.
+		 *
+		 * Bit \f$j\f$ of `validNoChange` is set if lane \f$j\f$ is a trial of the first
+		 * strategy; bit \f$j\f$ of `winNoChange` if that trial is won. Same for `Change`.
+		 */
+		void
+		next ( uint64_t &validNoChange, uint64_t &winNoChange, uint64_t &validChange, uint64_t &winChange ) {
+			uint64_t w[4];
+			rng_.next( w );
+
+			/// The car is behind door 0: keeping the door wins if the first choice is 0,
+			/// changing wins if it's 1 or 2.
+			validNoChange = ~( w[0] & w[1] );
+			winNoChange = ~( w[0] | w[1] );
+			validChange = ~( w[2] & w[3] );
+			winChange = w[2] ^ w[3];
+		}
+
+	private:
+		Xoshiro256Lanes<4> rng_;
+};
+
+/**
+ * @brief Play `trials` trials of each strategy with the generators of `chunk`.
+ */
+	inline void
+montyHallChunk ( unsigned long long trials, uint64_t seed, uint64_t chunk, MontyHallResult &result ) {
+	MontyHallWords words( seed, chunk );
+
+	unsigned long long leftNoChange = trials, leftChange = trials;
+	uint64_t validNoChange, winNoChange, validChange, winChange;
+	while ( leftNoChange || leftChange ) {
+		words.next( validNoChange, winNoChange, validChange, winChange );
+
+		if ( (unsigned long long) popCount( validNoChange ) > leftNoChange )
+			validNoChange = lowestBits( validNoChange, leftNoChange );
+		if ( (unsigned long long) popCount( validChange ) > leftChange )
+			validChange = lowestBits( validChange, leftChange );
+
+		leftNoChange -= popCount( validNoChange );
+		leftChange -= popCount( validChange );
+		result.noChange += popCount( winNoChange & validNoChange );
+		result.change += popCount( winChange & validChange );
+	}
+}
+
+/**
+ * @brief Play `trials` trials of each Monty Hall strategy.
+ */
+	inline MontyHallResult
+montyHall ( unsigned long long trials, uint64_t seed ) {
+	MontyHallResult result;
+	const long long chunks = ( trials + bitslicedChunk - 1 ) / bitslicedChunk;
+
+	#pragma omp parallel
+	{
+		MontyHallResult local;
+
+		#pragma omp for schedule(dynamic)
+		for ( long long chunk = 0; chunk < chunks; ++ chunk ) {
+			const unsigned long long first = chunk * bitslicedChunk;
+			const unsigned long long size = ( trials - first < bitslicedChunk ) ? trials - first : bitslicedChunk;
+			montyHallChunk( size, seed, chunk, local );
+		}
+
+		#pragma omp critical(bitsliced_games)
+		{
+			result.noChange += local.noChange;
+			result.change += local.change;
+		}
+	}
+
+	return result;
+}
+
+/**
+ * @brief Cumulative number of wins after each trial (serial, for short histories).
+ *
+ * @param noChange wins keeping the door after trials \f$0,\dots,n\f$ (`trials` values)
+ * @param change wins changing door after trials \f$0,\dots,n\f$ (`trials` values)
+ */
+	inline void
+montyHallHistory ( unsigned long long trials, uint64_t seed, unsigned long long *noChange, unsigned long long *change ) {
+	MontyHallWords words( seed, 0 );
+
+	unsigned long long i = 0, j = 0, winsNoChange = 0, winsChange = 0;
+	uint64_t validNoChange, winNoChange, validChange, winChange;
+	while ( i < trials || j < trials ) {
+		words.next( validNoChange, winNoChange, validChange, winChange );
+
+		for ( ; validNoChange && i < trials; validNoChange &= validNoChange - 1 )
+			noChange[i ++] = ( winsNoChange += winNoChange >> lowestBit( validNoChange ) & 1 );
+		for ( ; validChange && j < trials; validChange &= validChange - 1 )
+			change[j ++] = ( winsChange += winChange >> lowestBit( validChange ) & 1 );
+	}
+}
+
+#endif   /* ----- #ifndef bitsliced_games_INC  ----- */
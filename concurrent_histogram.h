@@ -0,0 +1,372 @@
+/**
+ *
+ *           @name  concurrent_histogram.h
+ *          @brief  Histograms that can be filled from many OpenMP threads.
+ *
+ *          `TH1::Fill()` is not thread-safe. These histograms keep one _shard_ (bin
+ *          contents, sums of squared weights and statistics) per thread: a thread only
+ *          writes to its own shard, so no lock or atomic operation is needed while filling.
+ *          The shards are summed when the histogram is exported to a ROOT histogram, in
+ *          parallel over the bins.
+ *
+ *          The bin index is found as in `TAxis::FindBin()`: computed inline, with the
+ *          same expression, for uniform binning, and by binary search over a copy of
+ *          the bin edges for variable binning. `fillN()` fills a whole array, computing
+ *          the bin indices of a block of values in a vectorizable loop first (uniform
+ *          binning only).
+ *
+ *          Example:
+ *          @code
+ *          	TH1D *hist = new TH1D( "hist", "", 100, -60, 60 );
+ *          	ConcurrentHisto1D concurrent( hist );  // same binning (and contents)
+ *          	#pragma omp parallel for
+ *          	for ( ... )
+ *          		concurrent.fill( x );
+ *          	concurrent.exportTo( hist );           // draw and fit as usual
+ *          @endcode
+ *          The statistics (\f$\sum w\f$, \f$\sum w^2\f$, \f$\sum wx\f$, \f$\sum wx^2\f$, ...)
+ *          are accumulated as `TH1::Fill()` does and exported with `TH1::PutStats()`, so
+ *          means and RMS are those of the unbinned values.
+ *
+ *          @attention A histogram has one shard per thread of the OpenMP team
+ *          (`omp_get_max_threads()` by default): it must not be filled by larger teams.
+ *
+ */
+
+#ifndef  concurrent_histogram_INC
+#define  concurrent_histogram_INC
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "TArrayD.h"
+#include "TAxis.h"
+#include "TH1.h"
+
+/**
+ * @brief Binning of one axis, uniform or with the edges of a variable-bin `TAxis`.
+ */
+struct ConcurrentHistoAxis {
+	ConcurrentHistoAxis ( int bins, double min, double max ) :
+		bins( bins ), min( min ), max( max ), width( max - min ) {}
+
+	ConcurrentHistoAxis ( const TAxis *axis ) :
+		bins( axis->GetNbins() ), min( axis->GetXmin() ), max( axis->GetXmax() ),
+		width( max - min ) {
+		const TArrayD *xbins = axis->GetXbins();
+		if ( xbins->GetSize() > 0 )
+			edges.assign( xbins->GetArray(), xbins->GetArray() + xbins->GetSize() );
+	}
+
+	bool uniform () const { return edges.empty(); }
+
+	/** @brief Bin of `x`: `0` for underflows, `bins + 1` for overflows, as in `TAxis::FindBin()`. */
+	int
+	find ( double x ) const {
+		if ( x < min )
+			return 0;
+		if ( ! ( x < max ) )
+			return bins + 1;
+		// number of edges <= x, i.e. 1 + TMath::BinarySearch() as in TAxis::FindBin()
+		if ( ! edges.empty() )
+			return std::upper_bound( edges.begin(), edges.end(), x ) - edges.begin();
+		// the same expression as TAxis::FindBin(), to get the same bin at the edges
+		return 1 + (int) ( bins * ( x - min ) / width );
+	}
+
+	int bins;
+	double min, max;
+	double width;              //!< Width of the axis.
+	std::vector<double> edges; //!< `bins + 1` edges of a variable binning, empty if uniform.
+};
+
+/**
+ * @brief Shards of a histogram with `cells` bins (including under- and overflows).
+ */
+class ConcurrentHistoShards {
+	public:
+		/// Statistics of a 2D histogram, as in `TH1::GetStats()`.
+		static const unsigned int maxStats = 7;
+
+		/**
+		 * @param cells number of bins, including under- and overflows
+		 * @param nStats 4 for 1D histograms, 7 for 2D ones
+		 * @param shards number of threads that will fill (`0` = `omp_get_max_threads()`)
+		 */
+		ConcurrentHistoShards ( int cells, unsigned int nStats, int shards ) :
+			cells_( cells ), nStats_( nStats ) {
+#ifdef _OPENMP
+			if ( shards <= 0 )
+				shards = omp_get_max_threads();
+#else
+			shards = 1;
+#endif
+			shards_.resize( shards );
+			for ( int s = 0; s < shards; ++ s ) {
+				shards_[s].sumw.assign( cells, 0. );
+				shards_[s].sumw2.assign( cells, 0. );
+			}
+			reset();
+		}
+
+		int cells () const { return cells_; }
+		int shards () const { return shards_.size(); }
+
+		/** @brief Empty all the shards. */
+		void
+		reset () {
+			for ( size_t s = 0; s < shards_.size(); ++ s ) {
+				Shard &shard = shards_[s];
+				shard.sumw.assign( cells_, 0. );
+				shard.sumw2.assign( cells_, 0. );
+				for ( unsigned int k = 0; k < maxStats; ++ k )
+					shard.stats[k] = 0.;
+				shard.entries = 0.;
+			}
+		}
+
+		/**
+		 * @brief Copy contents, errors, statistics and entries of `h` into the first shard.
+		 *
+		 * `h` must have the same number of bins.
+		 */
+		void
+		importFrom ( const TH1 *h ) {
+			reset();
+
+			Shard &shard = shards_[0];
+			const bool weighted = h->GetSumw2N() > 0;
+			for ( int bin = 0; bin < cells_; ++ bin ) {
+				shard.sumw[bin] = h->GetBinContent( bin );
+				shard.sumw2[bin] = weighted ? h->GetBinError( bin ) * h->GetBinError( bin ) : shard.sumw[bin];
+			}
+
+			double stats[maxStats] = {};
+			h->GetStats( stats );
+			for ( unsigned int k = 0; k < nStats_; ++ k )
+				shard.stats[k] = stats[k];
+			shard.entries = h->GetEntries();
+		}
+
+		/**
+		 * @brief Sum the shards into `h`, replacing its contents.
+		 *
+		 * `h` must have the same number of bins. Bin errors are set only if some
+		 * weight was not 1 (or `h` already stores the sums of squared weights).
+		 */
+		void
+		exportTo ( TH1 *h ) const {
+			std::vector<double> sumw( cells_, 0. ), sumw2( cells_, 0. );
+			int weighted = 0;
+
+			// each thread sums a slice of bins over all the shards: no locks needed
+			#pragma omp parallel for reduction(|:weighted)
+			for ( int bin = 0; bin < cells_; ++ bin ) {
+				for ( size_t s = 0; s < shards_.size(); ++ s ) {
+					sumw[bin] += shards_[s].sumw[bin];
+					sumw2[bin] += shards_[s].sumw2[bin];
+				}
+				weighted |= ( sumw2[bin] != sumw[bin] );
+			}
+
+			double stats[maxStats] = {}, entries = 0.;
+			for ( size_t s = 0; s < shards_.size(); ++ s ) {
+				for ( unsigned int k = 0; k < nStats_; ++ k )
+					stats[k] += shards_[s].stats[k];
+				entries += shards_[s].entries;
+			}
+
+			h->Reset();
+			if ( ( weighted || h->GetSumw2N() > 0 ) && h->GetSumw2N() == 0 )
+				h->Sumw2();
+
+			const bool errors = h->GetSumw2N() > 0;
+			for ( int bin = 0; bin < cells_; ++ bin ) {
+				h->SetBinContent( bin, sumw[bin] );
+				if ( errors )
+					h->SetBinError( bin, std::sqrt( sumw2[bin] ) );
+			}
+
+			// after SetBinContent(), which invalidates the statistics
+			h->PutStats( stats );
+			h->SetEntries( entries );
+		}
+
+	protected:
+		/** @brief Accumulators of one thread. */
+		struct Shard {
+			std::vector<double> sumw;  //!< Bin contents.
+			std::vector<double> sumw2; //!< Sums of squared weights.
+			double stats[maxStats];
+			double entries;
+			char padding[64];          //!< Keep the shards of two threads on different cache lines.
+		};
+
+		/** @brief The shard of the calling thread. */
+		Shard &
+		shard () {
+#ifdef _OPENMP
+			return shards_[omp_get_thread_num()];
+#else
+			return shards_[0];
+#endif
+		}
+
+		int cells_;
+		unsigned int nStats_;
+		std::vector<Shard> shards_;
+};
+
+/**
+ * @brief Concurrent 1D histogram.
+ */
+class ConcurrentHisto1D : public ConcurrentHistoShards {
+	public:
+		ConcurrentHisto1D ( int bins, double min, double max, int shards = 0 ) :
+			ConcurrentHistoShards( bins + 2, 4, shards ), axis_( bins, min, max ) {}
+
+		/** @brief Same binning as `h` (uniform or variable), whose contents are imported. */
+		ConcurrentHisto1D ( const TH1 *h, int shards = 0 ) :
+			ConcurrentHistoShards( h->GetXaxis()->GetNbins() + 2, 4, shards ),
+			axis_( h->GetXaxis() ) {
+			importFrom( h );
+		}
+
+		/** @brief Bin of `x`: `0` for underflows, `bins + 1` for overflows, as in `TAxis::FindBin()`. */
+		int
+		findBin ( double x ) const {
+			return axis_.find( x );
+		}
+
+		/** @brief Fill from the calling thread. */
+		void
+		fill ( double x, double w = 1. ) {
+			add( shard(), findBin( x ), x, w );
+		}
+
+		/**
+		 * @brief Fill `n` values from the calling thread.
+		 *
+		 * @param w weights (`NULL` for unit weights)
+		 */
+		void
+		fillN ( const double *x, const double *w, size_t n ) {
+			Shard &s = shard();
+			if ( ! axis_.uniform() ) {
+				for ( size_t j = 0; j < n; ++ j )
+					add( s, axis_.find( x[j] ), x[j], w ? w[j] : 1. );
+				return;
+			}
+
+			const int bins = axis_.bins;
+			const double min = axis_.min, max = axis_.max, width = axis_.width;
+			int bin[block];
+
+			for ( size_t first = 0; first < n; first += block ) {
+				const size_t size = ( n - first < (size_t) block ) ? n - first : (size_t) block;
+				const double *y = x + first;
+
+				#pragma omp simd
+				for ( size_t j = 0; j < size; ++ j ) {
+					const double u = bins * ( y[j] - min ) / width;
+					bin[j] = ( y[j] < min ) ? 0 : ( ( y[j] < max ) ? 1 + (int) u : bins + 1 );
+				}
+
+				for ( size_t j = 0; j < size; ++ j )
+					add( s, bin[j], y[j], w ? w[first + j] : 1. );
+			}
+		}
+
+		int bins () const { return axis_.bins; }
+
+	private:
+		enum { block = 256 }; //!< Values per batch of bin indices.
+
+		void
+		add ( Shard &s, int bin, double x, double w ) {
+			s.sumw[bin] += w;
+			s.sumw2[bin] += w * w;
+			s.entries += 1.;
+
+			// as TH1::Fill(), under- and overflows don't enter the statistics
+			if ( bin > 0 && bin <= axis_.bins ) {
+				s.stats[0] += w;
+				s.stats[1] += w * w;
+				s.stats[2] += w * x;
+				s.stats[3] += w * x * x;
+			}
+		}
+
+		ConcurrentHistoAxis axis_;
+};
+
+/**
+ * @brief Concurrent 2D histogram.
+ *
+ * Bins are numbered as in `TH1::GetBin()`: \f$b_x + (n_x + 2)\,b_y\f$.
+ */
+class ConcurrentHisto2D : public ConcurrentHistoShards {
+	public:
+		ConcurrentHisto2D ( int xBins, double xMin, double xMax, int yBins, double yMin, double yMax, int shards = 0 ) :
+			ConcurrentHistoShards( ( xBins + 2 ) * ( yBins + 2 ), 7, shards ),
+			x_( xBins, xMin, xMax ), y_( yBins, yMin, yMax ) {}
+
+		/** @brief Same binning as `h` (uniform or variable), whose contents are imported. */
+		ConcurrentHisto2D ( const TH1 *h, int shards = 0 ) :
+			ConcurrentHistoShards( ( h->GetXaxis()->GetNbins() + 2 ) * ( h->GetYaxis()->GetNbins() + 2 ), 7, shards ),
+			x_( h->GetXaxis() ), y_( h->GetYaxis() ) {
+			importFrom( h );
+		}
+
+		int
+		findBin ( double x, double y ) const {
+			return x_.find( x ) + ( x_.bins + 2 ) * y_.find( y );
+		}
+
+		/** @brief Fill from the calling thread. */
+		void
+		fill ( double x, double y, double w = 1. ) {
+			add( shard(), x_.find( x ), y_.find( y ), x, y, w );
+		}
+
+		/**
+		 * @brief Fill `n` points from the calling thread.
+		 *
+		 * @param w weights (`NULL` for unit weights)
+		 */
+		void
+		fillN ( const double *x, const double *y, const double *w, size_t n ) {
+			Shard &s = shard();
+			for ( size_t j = 0; j < n; ++ j )
+				add( s, x_.find( x[j] ), y_.find( y[j] ), x[j], y[j], w ? w[j] : 1. );
+		}
+
+	private:
+		void
+		add ( Shard &s, int binX, int binY, double x, double y, double w ) {
+			const int bin = binX + ( x_.bins + 2 ) * binY;
+			s.sumw[bin] += w;
+			s.sumw2[bin] += w * w;
+			s.entries += 1.;
+
+			if ( binX > 0 && binX <= x_.bins && binY > 0 && binY <= y_.bins ) {
+				s.stats[0] += w;
+				s.stats[1] += w * w;
+				s.stats[2] += w * x;
+				s.stats[3] += w * x * x;
+				s.stats[4] += w * y;
+				s.stats[5] += w * y * y;
+				s.stats[6] += w * x * y;
+			}
+		}
+
+		ConcurrentHistoAxis x_, y_;
+};
+
+#endif   /* ----- #ifndef concurrent_histogram_INC  ----- */
@@ -0,0 +1,286 @@
+/**
+ *
+ *           @name  moments.h
+ *          @brief  Single-pass, mergeable accumulators for means, (co)variances and
+ *          linear regression.
+ *
+ *          The naive formula \f$V[x] = \langle x^2\rangle - \langle x\rangle^2\f$ loses all
+ *          the significant digits when the mean is large compared to the spread (see
+ *          `varianceCheck.C`), and the two-pass formula needs to read the data twice. These
+ *          accumulators update the mean and the _centered_ moments at each step
+ *          (Welford's algorithm), which is stable and reads each value once:
+ *          \f[
+ *              \delta = x - \bar x_{n-1},\quad \bar x_n = \bar x_{n-1} + \delta/n,\quad
+ *              M_{2,n} = M_{2,n-1} + \delta\,(x - \bar x_n).
+ *          \f]
+ *          Two accumulators \f$a\f$, \f$b\f$ filled with different data can be combined
+ *          (Chan et al.) with
+ *          \f[
+ *              M_2 = M_{2,a} + M_{2,b} + \delta^2\,\frac{n_a n_b}{n_a + n_b},\quad
+ *              \delta = \bar x_b - \bar x_a,
+ *          \f]
+ *          so each thread can fill its own accumulator over a range of entries and the
+ *          results are merged at the end. The batch `push()` over an array evaluates the
+ *          moments of the batch with plain loops the compiler can vectorize and then
+ *          merges them.
+ *
+ */
+
+#ifndef  moments_INC
+#define  moments_INC
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief Mean and variance of one variable.
+ */
+class MomentAccumulator {
+	public:
+		MomentAccumulator () : n_( 0 ), mean_( 0. ), m2_( 0. ) {}
+
+		/** @brief Add one value. */
+		void
+		push ( double x ) {
+			++ n_;
+			const double delta = x - mean_;
+			mean_ += delta / n_;
+			m2_ += delta * ( x - mean_ );
+		}
+
+		/** @brief Add `n` values. */
+		void
+		push ( const double *x, size_t n ) {
+			if ( ! n )
+				return;
+
+			double sum = 0.;
+			for ( size_t j = 0; j < n; ++ j )
+				sum += x[j];
+			const double mean = sum / n;
+
+			double m2 = 0.;
+			for ( size_t j = 0; j < n; ++ j )
+				m2 += ( x[j] - mean ) * ( x[j] - mean );
+
+			merge( n, mean, m2 );
+		}
+
+		/** @brief Add the values collected by another accumulator. */
+		void merge ( const MomentAccumulator &other ) { merge( other.n_, other.mean_, other.m2_ ); }
+
+		size_t entries () const { return n_; }
+		double mean () const { return mean_; }
+		/** @brief Unbiased variance \f$M_2/(n-1)\f$. */
+		double variance () const { return ( n_ > 1 ) ? m2_ / ( n_ - 1 ) : 0.; }
+		/** @brief Variance of the sample \f$M_2/n\f$. */
+		double populationVariance () const { return ( n_ > 0 ) ? m2_ / n_ : 0.; }
+
+	private:
+		void
+		merge ( size_t n, double mean, double m2 ) {
+			if ( ! n )
+				return;
+
+			const size_t total = n_ + n;
+			const double delta = mean - mean_;
+			mean_ += delta * n / total;
+			m2_ += m2 + delta * delta * ( (double) n_ * n / total );
+			n_ = total;
+		}
+
+		size_t n_;
+		double mean_;
+		double m2_;
+};
+
+/**
+ * @brief Means and covariance matrix of a `D`-dimensional variable.
+ */
+class CovarianceAccumulator {
+	public:
+		CovarianceAccumulator ( unsigned int D ) :
+			D_( D ), n_( 0 ), mean_( D, 0. ), c_( D * D, 0. ), delta_( D, 0. ) {}
+
+		unsigned int dimension () const { return D_; }
+
+		/** @brief Add one event (an array of `dimension()` values). */
+		void
+		push ( const double *x ) {
+			++ n_;
+			for ( unsigned int i = 0; i < D_; ++ i ) {
+				delta_[i] = x[i] - mean_[i];
+				mean_[i] += delta_[i] / n_;
+			}
+
+			// c_ij += delta_i * ( x_j - newMean_j )
+			for ( unsigned int i = 0; i < D_; ++ i )
+				for ( unsigned int j = 0; j < D_; ++ j )
+					c_[i * D_ + j] += delta_[i] * ( x[j] - mean_[j] );
+		}
+
+		/** @brief Add `n` events stored one after the other (`n` x `dimension()` values). */
+		void
+		push ( const double *x, size_t n ) {
+			if ( ! n )
+				return;
+
+			CovarianceAccumulator batch( D_ );
+			batch.n_ = n;
+
+			for ( size_t e = 0; e < n; ++ e )
+				for ( unsigned int i = 0; i < D_; ++ i )
+					batch.mean_[i] += x[e * D_ + i];
+			for ( unsigned int i = 0; i < D_; ++ i )
+				batch.mean_[i] /= n;
+
+			for ( size_t e = 0; e < n; ++ e ) {
+				const double *event = x + e * D_;
+				for ( unsigned int i = 0; i < D_; ++ i )
+					for ( unsigned int j = 0; j < D_; ++ j )
+						batch.c_[i * D_ + j] += ( event[i] - batch.mean_[i] ) * ( event[j] - batch.mean_[j] );
+			}
+
+			merge( batch );
+		}
+
+		/** @brief Add the events collected by another accumulator of the same dimension. */
+		void
+		merge ( const CovarianceAccumulator &other ) {
+			if ( ! other.n_ )
+				return;
+
+			const size_t total = n_ + other.n_;
+			const double weight = (double) n_ * other.n_ / total;
+
+			for ( unsigned int i = 0; i < D_; ++ i )
+				delta_[i] = other.mean_[i] - mean_[i];
+
+			for ( unsigned int i = 0; i < D_; ++ i ) {
+				for ( unsigned int j = 0; j < D_; ++ j )
+					c_[i * D_ + j] += other.c_[i * D_ + j] + delta_[i] * delta_[j] * weight;
+
+				mean_[i] += delta_[i] * other.n_ / total;
+			}
+
+			n_ = total;
+		}
+
+		size_t entries () const { return n_; }
+		double mean ( unsigned int i ) const { return mean_[i]; }
+		/** @brief Unbiased covariance \f$C_{ij}/(n-1)\f$. */
+		double covariance ( unsigned int i, unsigned int j ) const {
+			return ( n_ > 1 ) ? c_[i * D_ + j] / ( n_ - 1 ) : 0.;
+		}
+
+	private:
+		unsigned int D_;
+		size_t n_;
+		std::vector<double> mean_;
+		std::vector<double> c_;     //!< Co-moments \f$\sum (x_i - \bar x_i)(x_j - \bar x_j)\f$.
+		std::vector<double> delta_; //!< Work array.
+};
+
+/**
+ * @brief Moments for the linear regression \f$y = ax + b\f$.
+ */
+class RegressionAccumulator {
+	public:
+		RegressionAccumulator () : n_( 0 ), xMean_( 0. ), yMean_( 0. ), cxx_( 0. ), cxy_( 0. ), cyy_( 0. ) {}
+
+		/** @brief Add one point. */
+		void
+		push ( double x, double y ) {
+			++ n_;
+			const double dx = x - xMean_;
+			const double dy = y - yMean_;
+			xMean_ += dx / n_;
+			yMean_ += dy / n_;
+
+			cxx_ += dx * ( x - xMean_ );
+			cxy_ += dx * ( y - yMean_ );
+			cyy_ += dy * ( y - yMean_ );
+		}
+
+		/** @brief Add `n` points. */
+		void
+		push ( const double *x, const double *y, size_t n ) {
+			if ( ! n )
+				return;
+
+			RegressionAccumulator batch;
+			batch.n_ = n;
+
+			double xSum = 0., ySum = 0.;
+			for ( size_t j = 0; j < n; ++ j ) {
+				xSum += x[j];
+				ySum += y[j];
+			}
+			batch.xMean_ = xSum / n;
+			batch.yMean_ = ySum / n;
+
+			double cxx = 0., cxy = 0., cyy = 0.;
+			for ( size_t j = 0; j < n; ++ j ) {
+				const double dx = x[j] - batch.xMean_;
+				const double dy = y[j] - batch.yMean_;
+				cxx += dx * dx;
+				cxy += dx * dy;
+				cyy += dy * dy;
+			}
+			batch.cxx_ = cxx;
+			batch.cxy_ = cxy;
+			batch.cyy_ = cyy;
+
+			merge( batch );
+		}
+
+		/** @brief Add the points collected by another accumulator. */
+		void
+		merge ( const RegressionAccumulator &other ) {
+			if ( ! other.n_ )
+				return;
+
+			const size_t total = n_ + other.n_;
+			const double weight = (double) n_ * other.n_ / total;
+			const double dx = other.xMean_ - xMean_;
+			const double dy = other.yMean_ - yMean_;
+
+			cxx_ += other.cxx_ + dx * dx * weight;
+			cxy_ += other.cxy_ + dx * dy * weight;
+			cyy_ += other.cyy_ + dy * dy * weight;
+
+			xMean_ += dx * other.n_ / total;
+			yMean_ += dy * other.n_ / total;
+			n_ = total;
+		}
+
+		size_t entries () const { return n_; }
+		double xMean () const { return xMean_; }
+		double yMean () const { return yMean_; }
+		/** @brief Variance of \f$x\f$ over the sample (normalized to \f$n\f$). */
+		double xVariance () const { return ( n_ > 0 ) ? cxx_ / n_ : 0.; }
+		/** @brief Variance of \f$y\f$ over the sample (normalized to \f$n\f$). */
+		double yVariance () const { return ( n_ > 0 ) ? cyy_ / n_ : 0.; }
+		/** @brief Covariance over the sample (normalized to \f$n\f$). */
+		double covariance () const { return ( n_ > 0 ) ? cxy_ / n_ : 0.; }
+
+		/** @brief Best slope \f$\hat a = \mathrm{cov}[x,y]/V[x]\f$. */
+		double slope () const { return cxy_ / cxx_; }
+		/** @brief Best intercept \f$\hat b = \langle y\rangle - \hat a\langle x\rangle\f$. */
+		double intercept () const { return yMean_ - slope() * xMean_; }
+
+		/**
+		 * @brief Sum of the squared residuals \f$\sum_i (y_i - \hat a x_i - \hat b)^2\f$.
+		 *
+		 * In terms of the centered moments it is \f$C_{yy} - C_{xy}^2\!/C_{xx}\f$, which
+		 * doesn't suffer from the cancellation of the raw-moment formula.
+		 */
+		double residuals () const { return cyy_ - cxy_ * cxy_ / cxx_; }
+
+	private:
+		size_t n_;
+		double xMean_, yMean_;
+		double cxx_, cxy_, cyy_; //!< Centered co-moments.
+};
+
+#endif   /* ----- #ifndef moments_INC  ----- */
@@ -0,0 +1,355 @@
+/**
+ *
+ *           @name  philox.h
+ *          @brief  Counter-based random numbers (Philox4x32-10) with array-filling
+ *          kernels for the common distributions.
+ *
+ *          A counter-based generator has no state: the random block is a bijective
+ *          scrambling of a _counter_ under a _key_ (Salmon et al., "Parallel random numbers:
+ *          as easy as 1, 2, 3"). Here the key is `(seed, stream)` and the counter is
+ *          `(index, attempt, kind)`, so
+ *          - variate \f$i\f$ of a stream doesn't depend on the others: any range of
+ *            indices can be drawn by any thread, in any order, with the same result;
+ *          - skipping ahead is free;
+ *          - streams (one per thread, per experiment, per purpose) are independent;
+ *          - variates of different kinds (uniform, gaussian, ...) with the same index
+ *            are independent, since `kind` is part of the counter.
+ *
+ *          The `fill*()` functions write \f$x_j = f(\mathit{first} + j)\f$ for
+ *          \f$j = 0,\dots,n-1\f$. The uniform, gaussian and exponential kernels are
+ *          plain loops (`omp simd`) over the Philox blocks, which the compiler can
+ *          vectorize; Poisson uses rejection and is evaluated element by element.
+ *
+ *          `PhiloxEngine` is a sequential view of a stream that satisfies the
+ *          _UniformRandomBitGenerator_ requirements, for the `<random>` distributions.
+ *
+ *          Example:
+ *          @code
+ *          	PhiloxRandom rng( seed, stream );
+ *          	std::vector<double> x( n );
+ *          	rng.fillGaus( &x[0], n, 0., 1. );         // indices 0, ..., n - 1
+ *          	rng.fillGaus( &x[0], n, 0., 1., 5 * n ); // indices 5n, ..., 6n - 1
+ *          @endcode
+ *
+ */
+
+#ifndef  philox_INC
+#define  philox_INC
+
+#include <cmath>
+#include <cstddef>
+#include <stdint.h>
+
+#include "Math/QuantFuncMathCore.h"
+
+/**
+ * @brief The Philox4x32-10 bijection.
+ *
+ * Scramble the counter `c` under the key `(k0, k1)` in place.
+ */
+	inline void
+philox4x32 ( uint32_t c[4], uint32_t k0, uint32_t k1 ) {
+	for ( unsigned int r = 0; r < 10; ++ r ) {
+		const uint64_t p0 = (uint64_t) 0xD2511F53U * c[0];
+		const uint64_t p1 = (uint64_t) 0xCD9E8D57U * c[2];
+
+		const uint32_t x0 = (uint32_t) ( p1 >> 32 ) ^ c[1] ^ k0;
+		const uint32_t x2 = (uint32_t) ( p0 >> 32 ) ^ c[3] ^ k1;
+		c[1] = (uint32_t) p1;
+		c[3] = (uint32_t) p0;
+		c[0] = x0;
+		c[2] = x2;
+
+		k0 += 0x9E3779B9U;
+		k1 += 0xBB67AE85U;
+	}
+}
+
+/**
+ * @brief Uniform double in \f$(0,1)\f$ from 53 random bits (never 0 nor 1).
+ */
+	inline double
+philoxToDouble ( uint32_t hi, uint32_t lo ) {
+	const uint64_t bits = ( (uint64_t) hi << 21 ) ^ ( lo >> 11 );
+	return ( bits + .5 ) * ( 1. / 9007199254740992. );
+}
+
+/**
+ * @brief Random variates of one stream, by index.
+ */
+class PhiloxRandom {
+	public:
+		/// Tags of the variates, stored in the last word of the counter.
+		enum Kind { uniformKind = 0, gausKind, poissonKind, exponentialKind, landauKind, engineKind };
+
+		/**
+		 * @param seed global seed of the simulation
+		 * @param stream index of the stream (thread, experiment, ...)
+		 */
+		PhiloxRandom ( uint32_t seed, uint32_t stream = 0 ) : seed_( seed ), stream_( stream ) {}
+
+		uint32_t seed () const { return seed_; }
+		uint32_t stream () const { return stream_; }
+
+		/**
+		 * @brief The random block for a counter.
+		 *
+		 * @param out the four 32-bit words of the block
+		 */
+		void
+		block ( uint64_t index, uint32_t attempt, uint32_t kind, uint32_t out[4] ) const {
+			out[0] = (uint32_t) index;
+			out[1] = (uint32_t) ( index >> 32 );
+			out[2] = attempt;
+			out[3] = kind;
+			philox4x32( out, seed_, stream_ );
+		}
+
+		/** @brief Uniform in \f$(0,1)\f$. */
+		double
+		uniform ( uint64_t i ) const {
+			return pairOf( i >> 1, 0, uniformKind, i & 1 );
+		}
+
+		/** @brief Integer uniform in \f$\{0,\dots,n-1\}\f$ (same bits as `uniform( i )`). */
+		unsigned int
+		integer ( uint64_t i, unsigned int n ) const {
+			return (unsigned int) ( uniform( i ) * n );
+		}
+
+		/**
+		 * @brief Gaussian, by Box-Muller.
+		 *
+		 * Variates \f$2j\f$ and \f$2j+1\f$ are the cosine and sine of the same pair of
+		 * uniforms.
+		 */
+		double
+		gaus ( uint64_t i, double mean = 0., double sigma = 1. ) const {
+			uint32_t b[4];
+			block( i >> 1, 0, gausKind, b );
+			double z[2];
+			boxMuller( b, z );
+			return mean + sigma * z[i & 1];
+		}
+
+		/** @brief Exponential with mean `tau`. */
+		double
+		exponential ( uint64_t i, double tau ) const {
+			return - tau * std::log( pairOf( i >> 1, 0, exponentialKind, i & 1 ) );
+		}
+
+		/** @brief Landau, as `TRandom::Landau()` (inverse of the distribution function). */
+		double
+		landau ( uint64_t i, double mpv = 0., double sigma = 1. ) const {
+			return mpv + ROOT::Math::landau_quantile( pairOf( i >> 1, 0, landauKind, i & 1 ), sigma );
+		}
+
+		/**
+		 * @brief Poisson with mean `lambda`.
+		 *
+		 * Multiplication of uniforms for \f$\lambda < 10\f$, otherwise the transformed
+		 * rejection with squeeze (PTRS) of Hörmann (1993). Each attempt takes a new
+		 * block of the counter `(i, attempt)`.
+		 */
+		unsigned int
+		poisson ( uint64_t i, double lambda ) const {
+			if ( lambda <= 0. )
+				return 0;
+
+			uint32_t b[4];
+			if ( lambda < 10. ) {
+				const double limit = std::exp( - lambda );
+				double product = 1.;
+				unsigned int k = 0;
+				for ( uint32_t attempt = 0; ; ++ attempt ) {
+					block( i, attempt, poissonKind, b );
+					for ( unsigned int h = 0; h < 2; ++ h ) {
+						product *= philoxToDouble( b[2 * h], b[2 * h + 1] );
+						if ( product <= limit )
+							return k;
+						++ k;
+					}
+				}
+			}
+
+			const double slam = std::sqrt( lambda );
+			const double logLambda = std::log( lambda );
+			const double beta = .931 + 2.53 * slam;
+			const double alpha = -.059 + .02483 * beta;
+			const double logInvAlpha = std::log( 1.1239 + 1.1328 / ( beta - 3.4 ) );
+			const double vr = .9277 - 3.6224 / ( beta - 2. );
+
+			for ( uint32_t attempt = 0; ; ++ attempt ) {
+				block( i, attempt, poissonKind, b );
+				const double U = philoxToDouble( b[0], b[1] ) - .5;
+				const double V = philoxToDouble( b[2], b[3] );
+				const double us = .5 - std::fabs( U );
+				const double k = std::floor( ( 2. * alpha / us + beta ) * U + lambda + .43 );
+
+				if ( us >= .07 && V <= vr )
+					return (unsigned int) k;
+				if ( k < 0. || ( us < .013 && V > us ) )
+					continue;
+				if ( std::log( V ) + logInvAlpha - std::log( alpha / ( us * us ) + beta )
+						<= - lambda + k * logLambda - std::lgamma( k + 1. ) )
+					return (unsigned int) k;
+			}
+		}
+
+		/** @brief `x[j] = uniform( first + j )`. */
+		void
+		fillUniform ( double *x, size_t n, uint64_t first = 0 ) const {
+			fillPairs( x, n, first, uniformKind, Identity() );
+		}
+
+		/** @brief `x[j] = gaus( first + j, mean, sigma )`. */
+		void
+		fillGaus ( double *x, size_t n, double mean = 0., double sigma = 1., uint64_t first = 0 ) const {
+			if ( ! n )
+				return;
+
+			// a leading odd index and a trailing even one only use half of their pair
+			size_t j = 0;
+			if ( first & 1 ) {
+				x[j ++] = gaus( first, mean, sigma );
+			}
+
+			const size_t pairs = ( n - j ) / 2;
+			const uint64_t firstPair = ( first + j ) >> 1;
+			double *y = x + j;
+
+			#pragma omp simd
+			for ( size_t p = 0; p < pairs; ++ p ) {
+				uint32_t b[4];
+				block( firstPair + p, 0, gausKind, b );
+				double z[2];
+				boxMuller( b, z );
+				y[2 * p] = mean + sigma * z[0];
+				y[2 * p + 1] = mean + sigma * z[1];
+			}
+
+			j += 2 * pairs;
+			if ( j < n )
+				x[j] = gaus( first + j, mean, sigma );
+		}
+
+		/** @brief `x[j] = exponential( first + j, tau )`. */
+		void
+		fillExponential ( double *x, size_t n, double tau, uint64_t first = 0 ) const {
+			fillPairs( x, n, first, exponentialKind, Exponential( tau ) );
+		}
+
+		/** @brief `x[j] = landau( first + j, mpv, sigma )`. */
+		void
+		fillLandau ( double *x, size_t n, double mpv = 0., double sigma = 1., uint64_t first = 0 ) const {
+			fillPairs( x, n, first, landauKind, Identity() );
+			for ( size_t j = 0; j < n; ++ j )
+				x[j] = mpv + ROOT::Math::landau_quantile( x[j], sigma );
+		}
+
+		/** @brief `k[j] = poisson( first + j, lambda )`. */
+		void
+		fillPoisson ( unsigned int *k, size_t n, double lambda, uint64_t first = 0 ) const {
+			for ( size_t j = 0; j < n; ++ j )
+				k[j] = poisson( first + j, lambda );
+		}
+
+	private:
+		struct Identity {
+			double operator() ( double u ) const { return u; }
+		};
+
+		struct Exponential {
+			Exponential ( double tau ) : tau( tau ) {}
+			double operator() ( double u ) const { return - tau * std::log( u ); }
+			double tau;
+		};
+
+		/** @brief One of the two uniforms of a block. */
+		double
+		pairOf ( uint64_t index, uint32_t attempt, uint32_t kind, unsigned int half ) const {
+			uint32_t b[4];
+			block( index, attempt, kind, b );
+			return philoxToDouble( b[2 * half], b[2 * half + 1] );
+		}
+
+		/** @brief Two gaussians from the two uniforms of a block. */
+		static void
+		boxMuller ( const uint32_t b[4], double z[2] ) {
+			const double r = std::sqrt( -2. * std::log( philoxToDouble( b[0], b[1] ) ) );
+			const double phi = 2. * M_PI * philoxToDouble( b[2], b[3] );
+			z[0] = r * std::cos( phi );
+			z[1] = r * std::sin( phi );
+		}
+
+		/** @brief `x[j] = f( u( first + j ) )`, with two uniforms per block. */
+		template <class F>
+		void
+		fillPairs ( double *x, size_t n, uint64_t first, uint32_t kind, F f ) const {
+			if ( ! n )
+				return;
+
+			size_t j = 0;
+			if ( first & 1 ) {
+				x[j] = f( pairOf( first >> 1, 0, kind, 1 ) );
+				++ j;
+			}
+
+			const size_t pairs = ( n - j ) / 2;
+			const uint64_t firstPair = ( first + j ) >> 1;
+			double *y = x + j;
+
+			#pragma omp simd
+			for ( size_t p = 0; p < pairs; ++ p ) {
+				uint32_t b[4];
+				block( firstPair + p, 0, kind, b );
+				y[2 * p] = f( philoxToDouble( b[0], b[1] ) );
+				y[2 * p + 1] = f( philoxToDouble( b[2], b[3] ) );
+			}
+
+			j += 2 * pairs;
+			if ( j < n )
+				x[j] = f( pairOf( ( first + j ) >> 1, 0, kind, 0 ) );
+		}
+
+		uint32_t seed_;
+		uint32_t stream_;
+};
+
+/**
+ * @brief Sequential 32-bit generator over a Philox stream.
+ *
+ * It can be passed to the `<random>` distributions in place of `std::mt19937`;
+ * `discard()` skips ahead in constant time.
+ */
+class PhiloxEngine {
+	public:
+		typedef uint32_t result_type;
+
+		PhiloxEngine ( uint32_t seed, uint32_t stream = 0 ) : rng_( seed, stream ), next_( 0 ) {}
+
+		static result_type min () { return 0; }
+		static result_type max () { return 0xFFFFFFFFU; }
+
+		result_type
+		operator() () {
+			if ( ! ( next_ & 3 ) )
+				rng_.block( next_ >> 2, 0, PhiloxRandom::engineKind, buffer_ );
+			return buffer_[next_ ++ & 3];
+		}
+
+		/** @brief Skip `z` words. */
+		void
+		discard ( unsigned long long z ) {
+			next_ += z;
+			if ( next_ & 3 )
+				rng_.block( next_ >> 2, 0, PhiloxRandom::engineKind, buffer_ );
+		}
+
+	private:
+		PhiloxRandom rng_;
+		uint64_t next_;       //!< Index of the next word.
+		uint32_t buffer_[4];  //!< Current block.
+};
+
+#endif   /* ----- #ifndef philox_INC  ----- */
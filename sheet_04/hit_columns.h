@@ -0,0 +1,297 @@
+/**
+ * @file hit_columns.h
+ *
+ * @brief Flat, memory-mapped columnar format for the hits of `buildTree.C`.
+ *
+ * The file is made of four contiguous sections:
+ * @code
+ * 	header   magic "HITCOL\0\0", version, nEvents, nHits  (32 bytes)
+ * 	offsets  uint64_t[nEvents + 1]   hits of event i are [offsets[i], offsets[i+1])
+ * 	amp      double[nHits]
+ * 	coord    double[nHits][3]
+ * @endcode
+ * The reader `mmap()`s the file and hands out pointers into it: an event is read
+ * with no copy, no decompression and no limit on the number of hits. Since all the
+ * sections are 8-byte aligned, the columns can be used as plain arrays.
+ *
+ * The writer doesn't know the number of hits in advance: offsets, amplitudes and
+ * coordinates are streamed to three temporary files which are appended to the
+ * header by `close()`.
+ *
+ * @attention The file is written in the byte order of the machine.
+ */
+
+#ifndef  hit_columns_INC
+#define  hit_columns_INC
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Header of a hit-column file.
+ */
+struct HitColumnsHeader {
+	char     magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t nEvents;
+	uint64_t nHits;
+};
+
+/// Magic string at the beginning of the file.
+static const char hitColumnsMagic[8] = { 'H', 'I', 'T', 'C', 'O', 'L', '\0', '\0' };
+
+/// Version of the format.
+static const uint32_t hitColumnsVersion = 1;
+
+/**
+ * @brief Write events to a hit-column file.
+ *
+ * @code
+ * 	HitColumnsWriter writer;
+ * 	writer.open("test.hits");
+ * 	for (...)
+ * 		writer.addEvent(nHits, hitAmp, hitCoord);
+ * 	writer.close();
+ * @endcode
+ */
+class HitColumnsWriter
+{
+	public:
+		HitColumnsWriter() : nEvents_(0), nHits_(0)
+		{
+			for (int k = 0; k < 3; ++k)
+				tmp_[k] = 0;
+		}
+
+		~HitColumnsWriter() { close(); }
+
+		/**
+		 * @brief Start a new file.
+		 *
+		 * @return `false` if the temporary files can't be created
+		 */
+		bool open(const char* fileName)
+		{
+			close();
+
+			fileName_ = fileName;
+			nEvents_ = 0;
+			nHits_ = 0;
+
+			for (int k = 0; k < 3; ++k) {
+				tmp_[k] = std::fopen(tmpName(k).c_str(), "w+b");
+				if ( not tmp_[k] ) {
+					discard();
+					return false;
+				}
+			}
+
+			// the first offset is always 0
+			const uint64_t zero = 0;
+			return std::fwrite(&zero, sizeof(zero), 1, tmp_[0]) == 1;
+		}
+
+		/**
+		 * @brief Append one event.
+		 *
+		 * @param amp the amplitudes of the `nHits` hits
+		 * @param coord the coordinates of the `nHits` hits
+		 */
+		bool addEvent(int nHits, const double* amp, const double (*coord)[3])
+		{
+			nHits_ += nHits;
+			++nEvents_;
+
+			const uint64_t offset = nHits_;
+			return std::fwrite(&offset, sizeof(offset), 1, tmp_[0]) == 1
+				and std::fwrite(amp, sizeof(double), nHits, tmp_[1]) == (size_t) nHits
+				and std::fwrite(coord, 3 * sizeof(double), nHits, tmp_[2]) == (size_t) nHits;
+		}
+
+		/**
+		 * @brief Write header and columns to the output file and remove the temporary files.
+		 *
+		 * @return `false` if nothing was open or if writing failed
+		 */
+		bool close()
+		{
+			if ( not tmp_[0] )
+				return false;
+
+			bool ok = false;
+			std::FILE* out = std::fopen(fileName_.c_str(), "wb");
+			if ( out ) {
+				HitColumnsHeader header;
+				std::memset(&header, 0, sizeof(header));
+				std::memcpy(header.magic, hitColumnsMagic, sizeof(header.magic));
+				header.version = hitColumnsVersion;
+				header.nEvents = nEvents_;
+				header.nHits   = nHits_;
+
+				ok = std::fwrite(&header, sizeof(header), 1, out) == 1;
+				for (int k = 0; k < 3 and ok; ++k)
+					ok = append(tmp_[k], out);
+
+				ok = ( std::fclose(out) == 0 ) and ok;
+			}
+
+			discard();
+			return ok;
+		}
+
+		unsigned long long nEvents() const { return nEvents_; }
+		unsigned long long nHits() const { return nHits_; }
+
+	private:
+		std::string tmpName(int k) const
+		{
+			static const char* suffix[3] = { ".offsets.tmp", ".amp.tmp", ".coord.tmp" };
+			return fileName_ + suffix[k];
+		}
+
+		/// Close and remove the temporary files.
+		void discard()
+		{
+			for (int k = 0; k < 3; ++k) {
+				if ( tmp_[k] ) {
+					std::fclose(tmp_[k]);
+					std::remove(tmpName(k).c_str());
+					tmp_[k] = 0;
+				}
+			}
+		}
+
+		/// Copy a whole temporary file at the end of `out`.
+		static bool append(std::FILE* in, std::FILE* out)
+		{
+			if ( std::fflush(in) != 0 or std::fseek(in, 0, SEEK_SET) != 0 )
+				return false;
+
+			std::vector<char> buffer(1 << 20);
+			size_t n;
+			while ( (n = std::fread(&buffer[0], 1, buffer.size(), in)) > 0 )
+				if ( std::fwrite(&buffer[0], 1, n, out) != n )
+					return false;
+
+			return not std::ferror(in);
+		}
+
+		std::string fileName_;
+		std::FILE*  tmp_[3];   ///< Offsets, amplitudes and coordinates.
+		uint64_t    nEvents_;
+		uint64_t    nHits_;
+};
+
+/**
+ * @brief Read-only, zero-copy view of a hit-column file.
+ *
+ * The view can be shared between threads: each one can loop over its own range of
+ * events.
+ */
+class HitColumns
+{
+	public:
+		HitColumns() : data_(0), size_(0), header_(0), offsets_(0), amp_(0), coord_(0) {}
+		~HitColumns() { close(); }
+
+		/**
+		 * @brief Map a file in memory.
+		 *
+		 * @return `false` if the file can't be mapped or is not a valid hit-column file
+		 */
+		bool open(const char* fileName)
+		{
+			close();
+
+			const int fd = ::open(fileName, O_RDONLY);
+			if ( fd < 0 )
+				return false;
+
+			struct stat st;
+			if ( fstat(fd, &st) != 0 or (size_t) st.st_size < sizeof(HitColumnsHeader) ) {
+				::close(fd);
+				return false;
+			}
+
+			void* data = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			// the mapping stays valid after the descriptor is closed
+			::close(fd);
+			if ( data == MAP_FAILED )
+				return false;
+
+			data_ = (const char*) data;
+			size_ = st.st_size;
+			header_ = (const HitColumnsHeader*) data_;
+
+			if ( std::memcmp(header_->magic, hitColumnsMagic, sizeof(hitColumnsMagic)) != 0
+					or header_->version != hitColumnsVersion
+					or size_ != sizeof(HitColumnsHeader)
+						+ (header_->nEvents + 1) * sizeof(uint64_t)
+						+ header_->nHits * 4 * sizeof(double) ) {
+				close();
+				return false;
+			}
+
+			offsets_ = (const uint64_t*) (data_ + sizeof(HitColumnsHeader));
+			amp_     = (const double*) (offsets_ + header_->nEvents + 1);
+			coord_   = (const double (*)[3]) (amp_ + header_->nHits);
+
+			// the columns are mostly read front to back
+			madvise((void*) data_, size_, MADV_SEQUENTIAL);
+			return true;
+		}
+
+		void close()
+		{
+			if ( data_ )
+				munmap((void*) data_, size_);
+
+			data_ = 0;
+			size_ = 0;
+			header_ = 0;
+			offsets_ = 0;
+			amp_ = 0;
+			coord_ = 0;
+		}
+
+		unsigned long long nEvents() const { return header_ ? header_->nEvents : 0; }
+		unsigned long long nHits() const { return header_ ? header_->nHits : 0; }
+
+		/// Number of hits in event `i`.
+		unsigned int hits(unsigned long long i) const { return offsets_[i + 1] - offsets_[i]; }
+		/// Index of the first hit of event `i` in the columns.
+		unsigned long long first(unsigned long long i) const { return offsets_[i]; }
+
+		/// Amplitudes of the hits of event `i`.
+		const double* amp(unsigned long long i) const { return amp_ + offsets_[i]; }
+		/// Coordinates of the hits of event `i`.
+		const double (*coord(unsigned long long i) const)[3] { return coord_ + offsets_[i]; }
+
+		/// The whole columns.
+		const uint64_t* offsets() const { return offsets_; }
+		const double* amp() const { return amp_; }
+		const double (*coord() const)[3] { return coord_; }
+
+	private:
+		// not copyable: the mapping would be released twice
+		HitColumns(const HitColumns&);
+		HitColumns& operator=(const HitColumns&);
+
+		const char*             data_;
+		size_t                  size_;
+		const HitColumnsHeader* header_;
+		const uint64_t*         offsets_;
+		const double*           amp_;
+		const double          (*coord_)[3];
+};
+
+#endif   /* ----- #ifndef hit_columns_INC  ----- */
@@ -0,0 +1,126 @@
+/**
+ *
+ *           @name  decay_chain.h
+ *          @brief  Ensemble engine for the radioactive decay simulation.
+ *
+ *          Instead of asking, for each surviving nucleus, whether its kinetic energy
+ *          exceeds the threshold, each time step is drawn directly from its exact
+ *          distribution. Every nucleus decays independently with probability \f$p\f$
+ *          (the threshold integral evaluated in `radioactive_decay.C`), so the number of
+ *          decays in one second is
+ *          \f[
+ *              d_t \sim \mathrm{Bin}(n_{t-1}, p)
+ *          \f]
+ *          and, since each \f$\alpha\f$-particle is detected with probability \f$\epsilon\f$,
+ *          the number of detected particles is the binomial thinning
+ *          \f$\mathrm{Bin}(d_t, \epsilon)\f$. One history then costs two variates per
+ *          second instead of one per nucleus.
+ *
+ *          Independent experiments are spread over the cores with OpenMP. Experiment
+ *          \f$e\f$ always draws from the Philox stream `(seed, e)` (see `philox.h`) so the
+ *          results do not depend on the number of threads.
+ *
+ */
+
+#ifndef  decay_chain_INC
+#define  decay_chain_INC
+
+#include <random>
+#include <vector>
+
+#include "../philox.h"
+
+/**
+ * @brief Histories of an ensemble of decay experiments.
+ *
+ * Arrays are stored experiment by experiment: the value for experiment `e` at time
+ * step `t` (with \f$t = 0,\dots,\f$ `steps` \f$-1\f$) is at index `e * steps + t`.
+ */
+struct DecayChainResult {
+	unsigned int experiments; //!< Number of simulated experiments.
+	unsigned int steps;       //!< Number of time steps per experiment.
+
+	std::vector<unsigned int> nuclei;   //!< Nuclei at the beginning of each step.
+	std::vector<unsigned int> decays;   //!< Decays during each step.
+	std::vector<unsigned int> detected; //!< Detected \f$\alpha\f$-particles during each step.
+};
+
+/**
+ * @brief Simulate decay chains drawing one binomial variate per time step.
+ */
+class DecayChain {
+	public:
+		/**
+		 * @param nuclei initial number of nuclei
+		 * @param steps number of time steps (seconds)
+		 * @param decayProb decay probability per nucleus per step
+		 * @param efficiency probability to detect an emitted \f$\alpha\f$-particle
+		 */
+		DecayChain ( unsigned int nuclei, unsigned int steps, double decayProb, double efficiency ) :
+			nuclei_( nuclei ), steps_( steps ), decayProb_( decayProb ), efficiency_( efficiency ) {}
+
+		unsigned int nuclei () const { return nuclei_; }
+		unsigned int steps () const { return steps_; }
+		double decayProb () const { return decayProb_; }
+		double efficiency () const { return efficiency_; }
+
+		/**
+		 * @brief Simulate a single experiment.
+		 *
+		 * The output arrays must have room for `steps()` values.
+		 *
+		 * @param experiment index of the experiment (selects the random stream)
+		 * @param seed global seed of the ensemble (the first word of the Philox key)
+		 */
+		void
+		runExperiment ( unsigned int experiment, uint32_t seed,
+				unsigned int *nuclei, unsigned int *decays, unsigned int *detected ) const {
+
+			PhiloxEngine engine( seed, experiment );
+
+			unsigned int n = nuclei_;
+			for ( unsigned int t = 0; t < steps_; ++ t ) {
+				nuclei[t] = n;
+
+				std::binomial_distribution<unsigned int> decay( n, decayProb_ );
+				decays[t] = decay( engine );
+
+				std::binomial_distribution<unsigned int> detector( decays[t], efficiency_ );
+				detected[t] = detector( engine );
+
+				n -= decays[t];
+			}
+		}
+
+		/**
+		 * @brief Simulate `experiments` independent experiments in parallel.
+		 *
+		 * @param seed global seed: the same seed gives the same ensemble regardless
+		 * of the number of threads
+		 */
+		void
+		run ( unsigned int experiments, uint32_t seed, DecayChainResult &result ) const {
+			result.experiments = experiments;
+			result.steps = steps_;
+
+			const size_t size = (size_t) experiments * steps_;
+			result.nuclei.assign( size, 0 );
+			result.decays.assign( size, 0 );
+			result.detected.assign( size, 0 );
+
+			#pragma omp parallel for schedule(dynamic)
+			for ( int e = 0; e < (int) experiments; ++ e ) {
+				const size_t offset = (size_t) e * steps_;
+				runExperiment( e, seed,
+						&result.nuclei[offset], &result.decays[offset], &result.detected[offset] );
+			}
+		}
+
+	private:
+		unsigned int nuclei_;
+		unsigned int steps_;
+		double decayProb_;
+		double efficiency_;
+};
+
+#endif   /* ----- #ifndef decay_chain_INC  ----- */
@@ -0,0 +1,218 @@
+/**
+ *
+ *           @name  lorentz_columns.h
+ *          @brief  Branch-selective bulk reader of `TLorentzVector` branches into
+ *          structure-of-arrays buffers.
+ *
+ *          The reader enables only the requested branches of the `TTree` (for particles of
+ *          which only the energy is needed, also the momentum sub-branches are switched
+ *          off when the branch is split), prefetches them with a large `TTreeCache` and
+ *          copies a whole batch of events into contiguous arrays \f$(E, p_x, p_y, p_z)\f$,
+ *          one array per component and per particle. Cuts and invariant masses are then
+ *          evaluated by vectorized kernels over the batch.
+ *
+ *          Example:
+ *          @code
+ *          	LorentzBulkReader reader( tree );
+ *          	const unsigned int g1 = reader.add( "g1" );
+ *          	const unsigned int beam = reader.add( "beam", true ); // energy only
+ *          	reader.setRange( 0, tree->GetEntries() );
+ *          	while ( unsigned int n = reader.next() ) {
+ *          		const double *E = reader.columns( beam ).E();
+ *          		...
+ *          	}
+ *          @endcode
+ *
+ */
+
+#ifndef  lorentz_columns_INC
+#define  lorentz_columns_INC
+
+#include <cmath>
+#include <vector>
+
+#include "TBranch.h"
+#include "TLorentzVector.h"
+#include "TObjArray.h"
+#include "TString.h"
+#include "TTree.h"
+
+/**
+ * @brief Components of one particle for a batch of events.
+ */
+class LorentzColumns {
+	public:
+		LorentzColumns ( unsigned int size = 0 ) : E_( size ), px_( size ), py_( size ), pz_( size ) {}
+
+		const double *E () const { return &E_[0]; }
+		const double *px () const { return &px_[0]; }
+		const double *py () const { return &py_[0]; }
+		const double *pz () const { return &pz_[0]; }
+
+		/** @brief Store the `j`-th event of the batch. */
+		void
+		set ( unsigned int j, const TLorentzVector &p ) {
+			E_[j] = p.T();
+			px_[j] = p.Px();
+			py_[j] = p.Py();
+			pz_[j] = p.Pz();
+		}
+
+	private:
+		std::vector<double> E_, px_, py_, pz_;
+};
+
+/**
+ * @brief Invariant mass of the system of two particles for `n` events.
+ *
+ * As `TLorentzVector::M()`, a negative \f$m^2\f$ gives \f$-\sqrt{-m^2}\f$.
+ */
+	inline void
+invariantMass ( const LorentzColumns &a, const LorentzColumns &b, double *mass, unsigned int n ) {
+	const double *Ea = a.E(), *xa = a.px(), *ya = a.py(), *za = a.pz();
+	const double *Eb = b.E(), *xb = b.px(), *yb = b.py(), *zb = b.pz();
+
+	#pragma omp simd
+	for ( unsigned int j = 0; j < n; ++ j ) {
+		const double E = Ea[j] + Eb[j];
+		const double x = xa[j] + xb[j];
+		const double y = ya[j] + yb[j];
+		const double z = za[j] + zb[j];
+
+		const double m2 = E * E - x * x - y * y - z * z;
+		mass[j] = ( m2 < 0. ) ? - std::sqrt( - m2 ) : std::sqrt( m2 );
+	}
+}
+
+/**
+ * @brief Flag the values in the open window \f$(lo, hi)\f$.
+ */
+	inline void
+inWindow ( const double *x, double lo, double hi, unsigned char *mask, unsigned int n ) {
+	#pragma omp simd
+	for ( unsigned int j = 0; j < n; ++ j )
+		mask[j] = ( lo < x[j] ) & ( x[j] < hi );
+}
+
+/**
+ * @brief Read `TLorentzVector` branches batch by batch.
+ *
+ * A reader works on one `TTree`; to read in parallel each thread needs its own
+ * `TFile`, `TTree` and reader.
+ */
+class LorentzBulkReader {
+	public:
+		/**
+		 * @param tree the input tree: all its branches are disabled
+		 * @param batchSize number of events per batch
+		 * @param cacheSize size of the `TTreeCache` in bytes
+		 */
+		LorentzBulkReader ( TTree *tree, unsigned int batchSize = 65536, Long64_t cacheSize = 64 * 1024 * 1024 ) :
+			tree_( tree ), batchSize_( batchSize ), cacheSize_( cacheSize ), next_( 0 ), last_( 0 ) {
+			tree_->SetBranchStatus( "*", 0 );
+		}
+
+		~LorentzBulkReader () {
+			for ( unsigned int k = 0; k < particles_.size(); ++ k ) {
+				delete particles_[k]->vector;
+				delete particles_[k];
+			}
+		}
+
+		/**
+		 * @brief Request a branch.
+		 *
+		 * @param energyOnly if the branch is split, read only the energy
+		 *
+		 * @return the index of the particle, to be passed to `columns()`
+		 */
+		unsigned int
+		add ( const char *name, bool energyOnly = false ) {
+			TBranch *branch = tree_->GetBranch( name );
+			setStatus( branch, true );
+
+			/// The momentum is the `fP` member of `TLorentzVector`.
+			if ( energyOnly ) {
+				TObjArray *subBranches = branch->GetListOfBranches();
+				for ( int k = 0; k < subBranches->GetEntriesFast(); ++ k ) {
+					TBranch *sub = (TBranch *) subBranches->At( k );
+					if ( TString( sub->GetName() ).Contains( "fP" ) )
+						setStatus( sub, false );
+				}
+			}
+
+			/// @attention `SetBranchAddress()` wants the address of a pointer, which must
+			/// not move: each particle is allocated on its own.
+			Particle *particle = new Particle( batchSize_ );
+			particles_.push_back( particle );
+			tree_->SetBranchAddress( name, &particle->vector );
+			tree_->AddBranchToCache( name, kTRUE );
+
+			return particles_.size() - 1;
+		}
+
+		/** @brief Read the entries in \f$[\f$ `first`, `last` \f$)\f$. */
+		void
+		setRange ( Long64_t first, Long64_t last ) {
+			next_ = first;
+			last_ = last;
+
+			tree_->SetCacheSize( cacheSize_ );
+			tree_->SetCacheEntryRange( first, last );
+			tree_->StopCacheLearningPhase();
+		}
+
+		/**
+		 * @brief Read the next batch.
+		 *
+		 * @return number of events in the batch (`0` at the end of the range)
+		 */
+		unsigned int
+		next () {
+			unsigned int n = 0;
+			for ( ; n < batchSize_ && next_ < last_; ++ n, ++ next_ ) {
+				tree_->GetEntry( next_ );
+
+				for ( unsigned int k = 0; k < particles_.size(); ++ k )
+					particles_[k]->columns.set( n, *particles_[k]->vector );
+			}
+
+			return n;
+		}
+
+		unsigned int batchSize () const { return batchSize_; }
+		const LorentzColumns &columns ( unsigned int k ) const { return particles_[k]->columns; }
+
+	private:
+		/** @brief Branch buffer and batch of one particle. */
+		struct Particle {
+			Particle ( unsigned int batchSize ) : vector( new TLorentzVector() ), columns( batchSize ) {}
+
+			TLorentzVector *vector;
+			LorentzColumns columns;
+		};
+
+		/** @brief Enable (or disable) a branch and all its sub-branches. */
+		static void
+		setStatus ( TBranch *branch, bool enable ) {
+			if ( enable )
+				branch->ResetBit( TBranch::kDoNotProcess );
+			else
+				branch->SetBit( TBranch::kDoNotProcess );
+
+			TObjArray *subBranches = branch->GetListOfBranches();
+			for ( int k = 0; k < subBranches->GetEntriesFast(); ++ k )
+				setStatus( (TBranch *) subBranches->At( k ), enable );
+		}
+
+		TTree *tree_;
+		unsigned int batchSize_;
+		Long64_t cacheSize_;
+
+		Long64_t next_; //!< Next entry to read.
+		Long64_t last_; //!< End of the range.
+
+		std::vector<Particle *> particles_;
+};
+
+#endif   /* ----- #ifndef lorentz_columns_INC  ----- */
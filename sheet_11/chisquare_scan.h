@@ -0,0 +1,423 @@
+/**
+ *
+ *           @name  chisquare_scan.h
+ *          @brief  \f$\Delta\chi^2\f$ surfaces and profiles for models linear in the parameters.
+ *
+ *          For a model \f$f(x;\theta) = \sum_k \theta_k\,\phi_k(x)\f$ fitted to points
+ *          \f$(x_i, y_i \pm \sigma_i)\f$ the \f$\chi^2\f$ is a quadratic form in \f$\theta\f$:
+ *          with the design matrix \f$\Phi_{ik} = \phi_k(x_i)/\sigma_i\f$ and
+ *          \f$A = \Phi^T\Phi\f$,
+ *          \f[
+ *              \chi^2(\theta) = \chi^2_\textup{min} + (\theta - \hat\theta)^T A\,(\theta - \hat\theta).
+ *          \f]
+ *          \f$A\f$ and \f$\hat\theta\f$ are evaluated once when the object is built, so
+ *          \f$\Delta\chi^2\f$ on a grid costs a few multiplications per point and doesn't
+ *          need to go through `TF1` or to loop over the data points again.
+ *
+ *          Along a row of the grid \f$\Delta\chi^2\f$ is a parabola in the scanned
+ *          parameter: its three coefficients are evaluated once per row and the row is
+ *          filled by a vectorized loop. Rows are spread over the threads with OpenMP.
+ *
+ */
+
+#ifndef  chisquare_scan_INC
+#define  chisquare_scan_INC
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "TGraphErrors.h"
+#include "TH1D.h"
+#include "TH2D.h"
+
+/**
+ * @brief \f$\Delta\chi^2\f$ for the \f$68.3\,\f$\% region of one parameter.
+ */
+const double deltaChiSquare1Par68 = 1.;
+/**
+ * @brief \f$\Delta\chi^2\f$ for the \f$68.3\,\f$\% region of two parameters.
+ */
+const double deltaChiSquare2Par68 = 2.30;
+/**
+ * @brief \f$\Delta\chi^2\f$ for the \f$90\,\f$\% region of two parameters.
+ */
+const double deltaChiSquare2Par90 = 4.61;
+
+/**
+ * @brief Polynomial basis \f$\phi_k(x) = x^k\f$, i.e. the model of ROOT's `polN`.
+ */
+	inline double
+polynomialBasis ( unsigned int k, double x ) {
+	double p = 1.;
+	for ( unsigned int j = 0; j < k; ++ j )
+		p *= x;
+	return p;
+}
+
+/**
+ * @brief \f$\chi^2\f$ of a model linear in its parameters.
+ */
+class LinearChiSquare {
+	public:
+		/**
+		 * @param graph data points; the errors on \f$x\f$ are ignored
+		 * @param nPars number of parameters
+		 * @param basis the functions \f$\phi_k(x)\f$ (default: `polN`, \f$N\f$ = `nPars` - 1)
+		 */
+		LinearChiSquare ( const TGraphErrors *graph, unsigned int nPars,
+				double (*basis)( unsigned int, double ) = polynomialBasis ) :
+			nPars_( nPars ), A_( nPars * nPars, 0. ), cov_( nPars * nPars, 0. ),
+			best_( nPars, 0. ), chiSquareMin_( 0. ) {
+
+			const double *x = graph->GetX();
+			const double *y = graph->GetY();
+			const double *ey = graph->GetEY();
+
+			/// Accumulate \f$A = \Phi^T\Phi\f$, \f$b = \Phi^T y/\sigma\f$ and \f$y^Ty/\sigma^2\f$.
+			std::vector<double> phi( nPars_ ), b( nPars_, 0. );
+			double yy = 0.;
+			for ( int i = 0; i < graph->GetN(); ++ i ) {
+				const double w = 1. / ey[i];
+
+				for ( unsigned int k = 0; k < nPars_; ++ k )
+					phi[k] = basis( k, x[i] ) * w;
+
+				for ( unsigned int k = 0; k < nPars_; ++ k ) {
+					b[k] += phi[k] * y[i] * w;
+					for ( unsigned int l = 0; l < nPars_; ++ l )
+						A_[k * nPars_ + l] += phi[k] * phi[l];
+				}
+
+				yy += y[i] * y[i] * w * w;
+			}
+
+			invert();
+
+			/// \f$\hat\theta = A^{-1}b\f$ and \f$\chi^2_\textup{min} = y^Ty/\sigma^2 - b^T\hat\theta\f$.
+			chiSquareMin_ = yy;
+			for ( unsigned int k = 0; k < nPars_; ++ k ) {
+				for ( unsigned int l = 0; l < nPars_; ++ l )
+					best_[k] += cov_[k * nPars_ + l] * b[l];
+
+				chiSquareMin_ -= b[k] * best_[k];
+			}
+		}
+
+		unsigned int nPars () const { return nPars_; }
+
+		/** @brief Best estimate of the `k`-th parameter. */
+		double best ( unsigned int k ) const { return best_[k]; }
+		/** @brief Error on the best estimate of the `k`-th parameter. */
+		double error ( unsigned int k ) const { return std::sqrt( cov_[k * nPars_ + k] ); }
+		/** @brief Covariance of the best estimates \f$(A^{-1})_{kl}\f$. */
+		double covariance ( unsigned int k, unsigned int l ) const { return cov_[k * nPars_ + l]; }
+		/** @brief \f$\chi^2\f$ at the minimum. */
+		double chiSquareMin () const { return chiSquareMin_; }
+
+		/**
+		 * @brief \f$\Delta\chi^2 = \chi^2(\theta) - \chi^2_\textup{min}\f$.
+		 *
+		 * @param theta array of `nPars()` parameters
+		 */
+		double
+		deltaChiSquare ( const double *theta ) const {
+			double delta = 0.;
+			for ( unsigned int k = 0; k < nPars_; ++ k ) {
+				const double dk = theta[k] - best_[k];
+				delta += A_[k * nPars_ + k] * dk * dk;
+				for ( unsigned int l = 0; l < k; ++ l )
+					delta += 2. * A_[k * nPars_ + l] * dk * ( theta[l] - best_[l] );
+			}
+			return delta;
+		}
+
+		/**
+		 * @brief Profile \f$\Delta\chi^2\f$ of the `k`-th parameter.
+		 *
+		 * The other parameters are set to the values minimizing \f$\chi^2\f$ at fixed
+		 * \f$\theta_k\f$. For a linear model this gives
+		 * \f$(\theta_k - \hat\theta_k)^2 / (A^{-1})_{kk}\f$.
+		 */
+		double
+		profile ( unsigned int k, double value ) const {
+			const double d = value - best_[k];
+			return d * d / cov_[k * nPars_ + k];
+		}
+
+		/**
+		 * @brief Fill `histo` with \f$\Delta\chi^2\f$ as a function of the `k`-th
+		 * parameter, the others being fixed to `theta`.
+		 *
+		 * The function is evaluated at the bin centers.
+		 */
+		void
+		scan ( TH1D *histo, unsigned int k, const double *theta ) const {
+			std::vector<double> t( theta, theta + nPars_ );
+			for ( int b = 1; b <= histo->GetNbinsX(); ++ b ) {
+				t[k] = histo->GetBinCenter( b );
+				histo->SetBinContent( b, deltaChiSquare( &t[0] ) );
+			}
+		}
+
+		/**
+		 * @brief Fill `histo` with \f$\Delta\chi^2\f$ as a function of the `i`-th
+		 * (\f$x\f$-axis) and `j`-th (\f$y\f$-axis) parameters, the others being fixed
+		 * to `theta`.
+		 *
+		 * The function is evaluated at every bin center.
+		 */
+		void
+		scan ( TH2D *histo, unsigned int i, unsigned int j, const double *theta ) const {
+			const int nx = histo->GetNbinsX();
+			const int ny = histo->GetNbinsY();
+
+			std::vector<double> u( nx ), v( ny ), grid( (size_t) nx * ny );
+			for ( int b = 0; b < nx; ++ b )
+				u[b] = histo->GetXaxis()->GetBinCenter( b + 1 );
+			for ( int b = 0; b < ny; ++ b )
+				v[b] = histo->GetYaxis()->GetBinCenter( b + 1 );
+
+			#pragma omp parallel for
+			for ( int b = 0; b < nx; ++ b )
+				row( i, j, theta, u[b], &v[0], ny, &grid[(size_t) b * ny] );
+
+			fill( histo, grid );
+		}
+
+		/**
+		 * @brief Like `scan()` but with exact evaluations only close to the contours.
+		 *
+		 * \f$\Delta\chi^2\f$ is first evaluated on a coarse lattice of bin centers, one
+		 * every `step` bins. Coarse cells where the values at the corners straddle one of
+		 * the `levels` are evaluated bin by bin; the others are filled by bilinear
+		 * interpolation of the corners. The cell holding the minimum of the
+		 * \f$(\theta_i, \theta_j)\f$ slice is always evaluated bin by bin, so that a
+		 * closed contour smaller than one cell is not lost.
+		 *
+		 * @attention A contour which enters and leaves a coarse cell through the same
+		 * side may still be missed: choose `step` small compared to the size of the
+		 * contours.
+		 *
+		 * `step = 0` is taken as 1. A histogram with a single bin along an axis has no
+		 * cell to interpolate in, and is filled by `scan()`.
+		 *
+		 * @return the number of exact evaluations
+		 */
+		size_t
+		scanAdaptive ( TH2D *histo, unsigned int i, unsigned int j, const double *theta,
+				const double *levels, unsigned int nLevels, unsigned int step = 16 ) const {
+			const int nx = histo->GetNbinsX();
+			const int ny = histo->GetNbinsY();
+
+			if ( nx < 2 || ny < 2 ) {
+				scan( histo, i, j, theta );
+				return (size_t) nx * ny;
+			}
+			if ( step < 1 )
+				step = 1;
+
+			std::vector<double> u( nx ), v( ny ), grid( (size_t) nx * ny, 0. );
+			for ( int b = 0; b < nx; ++ b )
+				u[b] = histo->GetXaxis()->GetBinCenter( b + 1 );
+			for ( int b = 0; b < ny; ++ b )
+				v[b] = histo->GetYaxis()->GetBinCenter( b + 1 );
+
+			// coarse lattice: every `step` bins plus the last one
+			std::vector<int> cx, cy;
+			for ( int b = 0; b < nx - 1; b += step )
+				cx.push_back( b );
+			cx.push_back( nx - 1 );
+			for ( int b = 0; b < ny - 1; b += step )
+				cy.push_back( b );
+			cy.push_back( ny - 1 );
+
+			// the lattice values are written here once and only read by the cells
+			std::vector<double> t( theta, theta + nPars_ ), coarse( cx.size() * cy.size() );
+			for ( size_t a = 0; a < cx.size(); ++ a ) {
+				for ( size_t c = 0; c < cy.size(); ++ c ) {
+					t[i] = u[cx[a]];
+					t[j] = v[cy[c]];
+					coarse[a * cy.size() + c] = deltaChiSquare( &t[0] );
+					grid[(size_t) cx[a] * ny + cy[c]] = coarse[a * cy.size() + c];
+				}
+			}
+			size_t evaluations = cx.size() * cy.size();
+
+			double minI, minJ;
+			sliceMinimum( i, j, theta, minI, minJ );
+
+			#pragma omp parallel for reduction(+:evaluations) schedule(dynamic)
+			for ( int a = 0; a < (int) cx.size() - 1; ++ a ) {
+				const int x0 = cx[a], x1 = cx[a + 1];
+
+				for ( size_t c = 0; c + 1 < cy.size(); ++ c ) {
+					const int y0 = cy[c], y1 = cy[c + 1];
+
+					const double f00 = coarse[a * cy.size() + c];
+					const double f01 = coarse[a * cy.size() + c + 1];
+					const double f10 = coarse[( a + 1 ) * cy.size() + c];
+					const double f11 = coarse[( a + 1 ) * cy.size() + c + 1];
+
+					const double lo = std::min( std::min( f00, f01 ), std::min( f10, f11 ) );
+					const double hi = std::max( std::max( f00, f01 ), std::max( f10, f11 ) );
+
+					bool crossed = u[x0] <= minI && minI <= u[x1] && v[y0] <= minJ && minJ <= v[y1];
+					for ( unsigned int l = 0; l < nLevels; ++ l )
+						crossed = crossed || ( lo <= levels[l] && levels[l] <= hi );
+
+					// each cell owns its lower edges, the last ones also the upper edges;
+					// the lattice points are already exact and are left alone
+					const int xEnd = ( a + 2 == (int) cx.size() ) ? x1 : x1 - 1;
+					const int yEnd = ( c + 2 == cy.size() ) ? y1 : y1 - 1;
+
+					for ( int bx = x0; bx <= xEnd; ++ bx ) {
+						const bool lattice = ( bx == x0 || bx == x1 );
+						const int yBegin = lattice ? y0 + 1 : y0;
+						const int yLast = ( lattice && yEnd == y1 ) ? y1 - 1 : yEnd;
+
+						if ( crossed ) {
+							if ( yLast >= yBegin ) {
+								row( i, j, theta, u[bx], &v[yBegin], yLast - yBegin + 1, &grid[(size_t) bx * ny + yBegin] );
+								evaluations += yLast - yBegin + 1;
+							}
+							continue;
+						}
+
+						const double s = (double) ( bx - x0 ) / ( x1 - x0 );
+						for ( int by = yBegin; by <= yLast; ++ by ) {
+							const double r = (double) ( by - y0 ) / ( y1 - y0 );
+							grid[(size_t) bx * ny + by] =
+								( 1. - s ) * ( ( 1. - r ) * f00 + r * f01 ) + s * ( ( 1. - r ) * f10 + r * f11 );
+						}
+					}
+				}
+			}
+
+			fill( histo, grid );
+			return evaluations;
+		}
+
+	private:
+		/**
+		 * @brief Minimum of \f$\Delta\chi^2\f$ in the \f$(\theta_i, \theta_j)\f$ plane, the
+		 * others being fixed to `theta`.
+		 *
+		 * With \f$d = \theta - \hat\theta\f$ the gradient along \f$d_i\f$ and \f$d_j\f$
+		 * vanishes where \f$A_{ii} d_i + A_{ij} d_j = -r_i\f$ and
+		 * \f$A_{ji} d_i + A_{jj} d_j = -r_j\f$, with \f$r_m = \sum_{l\neq i,j} A_{ml} d_l\f$.
+		 */
+		void
+		sliceMinimum ( unsigned int i, unsigned int j, const double *theta, double &minI, double &minJ ) const {
+			double ri = 0., rj = 0.;
+			for ( unsigned int l = 0; l < nPars_; ++ l ) {
+				if ( l == i || l == j )
+					continue;
+
+				const double dl = theta[l] - best_[l];
+				ri += A_[i * nPars_ + l] * dl;
+				rj += A_[j * nPars_ + l] * dl;
+			}
+
+			const double aii = A_[i * nPars_ + i], aij = A_[i * nPars_ + j], ajj = A_[j * nPars_ + j];
+			const double det = aii * ajj - aij * aij;
+			minI = best_[i] + ( - ri * ajj + rj * aij ) / det;
+			minJ = best_[j] + ( - rj * aii + ri * aij ) / det;
+		}
+
+		/**
+		 * @brief \f$\Delta\chi^2\f$ along a row: \f$\theta_i\f$ = `ui` and \f$\theta_j\f$
+		 * running over `vj[0]`, ..., `vj[n-1]`.
+		 *
+		 * With \f$d = \theta - \hat\theta\f$ the row is the parabola
+		 * \f$c_0 + c_1 d_j + A_{jj} d_j^2\f$, whose coefficients don't depend on \f$d_j\f$.
+		 */
+		void
+		row ( unsigned int i, unsigned int j, const double *theta, double ui,
+				const double *vj, int n, double *out ) const {
+			std::vector<double> d( nPars_ );
+			for ( unsigned int k = 0; k < nPars_; ++ k )
+				d[k] = theta[k] - best_[k];
+			d[i] = ui - best_[i];
+			d[j] = 0.;
+
+			double c0 = 0., c1 = 0.;
+			for ( unsigned int k = 0; k < nPars_; ++ k ) {
+				double Ad = 0.;
+				for ( unsigned int l = 0; l < nPars_; ++ l )
+					Ad += A_[k * nPars_ + l] * d[l];
+
+				c0 += d[k] * Ad;
+				if ( k == j )
+					c1 = 2. * Ad;
+			}
+
+			const double c2 = A_[j * nPars_ + j];
+			const double bj = best_[j];
+
+			#pragma omp simd
+			for ( int b = 0; b < n; ++ b ) {
+				const double dj = vj[b] - bj;
+				out[b] = c0 + ( c1 + c2 * dj ) * dj;
+			}
+		}
+
+		/** @brief Copy the grid (stored row by row along \f$x\f$) into the histogram. */
+		static void
+		fill ( TH2D *histo, const std::vector<double> &grid ) {
+			const int nx = histo->GetNbinsX();
+			const int ny = histo->GetNbinsY();
+			for ( int b = 0; b < nx; ++ b )
+				for ( int bb = 0; bb < ny; ++ bb )
+					histo->SetBinContent( b + 1, bb + 1, grid[(size_t) b * ny + bb] );
+		}
+
+		/**
+		 * @brief Invert \f$A\f$ into `cov_` (Gauss-Jordan with partial pivoting).
+		 */
+		void
+		invert () {
+			const unsigned int n = nPars_;
+			std::vector<double> a( A_ );
+
+			for ( unsigned int k = 0; k < n; ++ k )
+				cov_[k * n + k] = 1.;
+
+			for ( unsigned int c = 0; c < n; ++ c ) {
+				unsigned int p = c;
+				for ( unsigned int r = c + 1; r < n; ++ r )
+					if ( std::fabs( a[r * n + c] ) > std::fabs( a[p * n + c] ) )
+						p = r;
+
+				for ( unsigned int k = 0; k < n; ++ k ) {
+					std::swap( a[c * n + k], a[p * n + k] );
+					std::swap( cov_[c * n + k], cov_[p * n + k] );
+				}
+
+				const double pivot = 1. / a[c * n + c];
+				for ( unsigned int k = 0; k < n; ++ k ) {
+					a[c * n + k] *= pivot;
+					cov_[c * n + k] *= pivot;
+				}
+
+				for ( unsigned int r = 0; r < n; ++ r ) {
+					if ( r == c )
+						continue;
+
+					const double factor = a[r * n + c];
+					for ( unsigned int k = 0; k < n; ++ k ) {
+						a[r * n + k] -= factor * a[c * n + k];
+						cov_[r * n + k] -= factor * cov_[c * n + k];
+					}
+				}
+			}
+		}
+
+		unsigned int nPars_;
+		std::vector<double> A_;     //!< \f$A = \Phi^T\Phi\f$, row-major.
+		std::vector<double> cov_;   //!< \f$A^{-1}\f$, row-major.
+		std::vector<double> best_;  //!< \f$\hat\theta\f$.
+		double chiSquareMin_;
+};
+
+#endif   /* ----- #ifndef chisquare_scan_INC  ----- */
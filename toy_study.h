@@ -0,0 +1,277 @@
+/**
+ *
+ *           @name  toy_study.h
+ *          @brief  Parallel toy Monte Carlo driver for pull and coverage studies.
+ *
+ *          A _toy_ generates one pseudo-data set from the true parameters and fits it. The
+ *          driver plays many toys on all the cores and collects the pulls
+ *          \f$(\hat\theta_k - \theta_k)/\sigma_{\hat\theta_k}\f$, the \f$\chi^2\f$ and the
+ *          \f$\chi^2\f$-probability of the fits.
+ *
+ *          The generator and the fit model are given as a class with this interface:
+ *          @code
+ *          	struct MyToy {
+ *          		MyToy ();                                // build histograms, graphs, TF1s
+ *          		bool play ( TRandom &rng, ToyFit &fit ); // generate, fit, store results
+ *          	};
+ *          @endcode
+ *          Each thread builds its own `MyToy` once and reuses it for all its toys, so
+ *          nothing is allocated inside the loop and memory stays flat. `play()` must
+ *          draw random numbers from `rng` only (not from `gRandom`) and should return
+ *          `false` if the fit failed. Failed fits are left out of the pulls and counted.
+ *
+ *          ROOT objects need unique names: take them from `ToyStudy::uniqueName()`, e.g.
+ *          @code
+ *          	MyToy () : histo_( ToyStudy::uniqueName( "histoToy" ), "", 100, 0., 1. ) {}
+ *          @endcode
+ *
+ *          Toys are handed out to the threads in small chunks (OpenMP dynamic schedule)
+ *          so that slow fits don't leave cores idle. Toy \f$t\f$ always gets a generator
+ *          seeded with `(seed, t)`, hence the results don't depend on the number of threads.
+ *
+ */
+
+#ifndef  toy_study_INC
+#define  toy_study_INC
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "RVersion.h"
+#include "TROOT.h"
+#include "TH1D.h"
+#include "TMath.h"
+#include "TRandom3.h"
+#include "TString.h"
+#include "TStopwatch.h"
+#include "Math/MinimizerOptions.h"
+
+/**
+ * @brief Result of the fit of one toy.
+ */
+struct ToyFit {
+	ToyFit ( unsigned int nPars ) : par( nPars, 0. ), err( nPars, 0. ), chiSquare( 0. ), ndf( 0 ) {}
+
+	std::vector<double> par; //!< Best estimates of the parameters.
+	std::vector<double> err; //!< Errors on the best estimates.
+	double chiSquare;        //!< \f$\chi^2\f$ of the fit.
+	int ndf;                 //!< Number of degrees of freedom.
+};
+
+/**
+ * @brief Run toys in parallel and collect pulls, \f$\chi^2\f$ and \f$\chi^2\f$-probability.
+ */
+class ToyStudy {
+	public:
+		/**
+		 * @param name prefix for the names of the histograms
+		 * @param nPars number of fit parameters
+		 * @param truePars the parameters used to generate the toys
+		 */
+		ToyStudy ( const char *name, unsigned int nPars, const double *truePars ) :
+			name_( name ), truePars_( truePars, truePars + nPars ),
+			pullBins_( 100 ), pullMin_( -2.5 ), pullMax_( 2.5 ),
+			chiSquareBins_( 100 ), chiSquareMin_( 0. ), chiSquareMax_( 10. ), reduced_( false ),
+			probBins_( 100 ), chiSquare_( 0 ), prob_( 0 ), toys_( 0 ), failed_( 0 ), time_( 0. ) {}
+
+		~ToyStudy () {
+			for ( unsigned int k = 0; k < pull_.size(); ++ k )
+				delete pull_[k];
+			delete chiSquare_;
+			delete prob_;
+		}
+
+		/** @brief Set the binning of the pull histograms (default: 100 bins in \f$[-2.5,2.5]\f$). */
+		void setPullRange ( unsigned int bins, double min, double max ) {
+			pullBins_ = bins; pullMin_ = min; pullMax_ = max;
+		}
+
+		/**
+		 * @brief Set the binning of the \f$\chi^2\f$ histogram.
+		 *
+		 * Default: 100 bins in \f$[0,10]\f$. If `reduced` is `true`, \f$\chi^2\!/n\f$ is
+		 * histogrammed instead.
+		 */
+		void setChiSquareRange ( unsigned int bins, double min, double max, bool reduced = false ) {
+			chiSquareBins_ = bins; chiSquareMin_ = min; chiSquareMax_ = max; reduced_ = reduced;
+		}
+
+		/** @brief Set the number of bins of the \f$\chi^2\f$-probability histogram. */
+		void setProbBins ( unsigned int bins ) { probBins_ = bins; }
+
+		/**
+		 * @brief Play `toys` toys.
+		 *
+		 * @param seed the same seed gives the same histograms regardless of the threads
+		 */
+		template <class Toy>
+		void
+		run ( unsigned int toys, unsigned int seed ) {
+			// histograms built inside the threads must not be attached to gDirectory
+			const bool addDirectory = TH1::AddDirectoryStatus();
+			TH1::AddDirectory( kFALSE );
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,0,0)
+			ROOT::EnableThreadSafety();
+#endif
+			// TMinuit keeps a global state: use the reentrant Minuit2 for the study only
+			const std::string minimizer = ROOT::Math::MinimizerOptions::DefaultMinimizerType();
+			const std::string algorithm = ROOT::Math::MinimizerOptions::DefaultMinimizerAlgo();
+			ROOT::Math::MinimizerOptions::SetDefaultMinimizer( "Minuit2" );
+
+			book();
+
+			TStopwatch watch;
+			watch.Start();
+
+			unsigned int failed = 0;
+			#pragma omp parallel reduction(+:failed)
+			{
+				Toy *toy;
+				std::vector<TH1D *> pull( truePars_.size() );
+				TH1D *chiSquare, *prob;
+
+				#pragma omp critical(toy_study)
+				{
+					toy = new Toy();
+					for ( unsigned int k = 0; k < pull.size(); ++ k )
+						pull[k] = (TH1D *) pull_[k]->Clone();
+					chiSquare = (TH1D *) chiSquare_->Clone();
+					prob = (TH1D *) prob_->Clone();
+				}
+
+				TRandom3 rng;
+				ToyFit fit( truePars_.size() );
+
+				#pragma omp for schedule(dynamic, 16)
+				for ( int t = 0; t < (int) toys; ++ t ) {
+					rng.SetSeed( toySeed( seed, t ) );
+
+					if ( ! toy->play( rng, fit ) ) {
+						++ failed;
+						continue;
+					}
+
+					for ( unsigned int k = 0; k < pull.size(); ++ k )
+						pull[k]->Fill( ( fit.par[k] - truePars_[k] ) / fit.err[k] );
+
+					chiSquare->Fill( reduced_ ? fit.chiSquare / fit.ndf : fit.chiSquare );
+					prob->Fill( TMath::Prob( fit.chiSquare, fit.ndf ) );
+				}
+
+				/// Merge the histograms of the thread into the final ones.
+				#pragma omp critical(toy_study)
+				{
+					for ( unsigned int k = 0; k < pull.size(); ++ k ) {
+						pull_[k]->Add( pull[k] );
+						delete pull[k];
+					}
+					chiSquare_->Add( chiSquare );
+					prob_->Add( prob );
+
+					delete chiSquare;
+					delete prob;
+					delete toy;
+				}
+			}
+
+			watch.Stop();
+			time_ = watch.RealTime();
+			toys_ = toys;
+			failed_ = failed;
+
+			TH1::AddDirectory( addDirectory );
+			ROOT::Math::MinimizerOptions::SetDefaultMinimizer( minimizer.c_str(), algorithm.c_str() );
+
+			std::cout << " >> [" << name_ << "] " << toys_ << " toys ("
+				<< failed_ << " failed fits) in " << time_ << " s: "
+				<< toysPerSecond() << " toys/s" << std::endl;
+			if ( failed_ )
+				std::cerr << " >> [" << name_ << "] warning: the " << failed_
+					<< " failed fits are not in the pulls" << std::endl;
+		}
+
+		/**
+		 * @brief A name never returned before, `prefix` followed by a counter.
+		 *
+		 * The toys are built one at a time (in a critical section), so the counter
+		 * needs no further protection there.
+		 */
+		static TString
+		uniqueName ( const char *prefix ) {
+			static unsigned int instances = 0;
+			return TString::Format( "%s%u", prefix, instances ++ );
+		}
+
+		/** @brief Pulls of the `k`-th parameter. */
+		TH1D *pull ( unsigned int k ) const { return pull_[k]; }
+		/** @brief \f$\chi^2\f$ (or \f$\chi^2\!/n\f$) of the fits. */
+		TH1D *chiSquare () const { return chiSquare_; }
+		/** @brief \f$P(\chi^2 > \chi^2_\textup{obs})\f$ of the fits. */
+		TH1D *prob () const { return prob_; }
+
+		unsigned int failed () const { return failed_; }
+		double toysPerSecond () const { return ( time_ > 0. ) ? toys_ / time_ : 0.; }
+
+	private:
+		/**
+		 * @brief Seed for toy `t`.
+		 *
+		 * The pair `(seed, t)` is scrambled with the _splitmix64_ finalizer so that
+		 * neighbouring toys get unrelated seeds. `0` is avoided since it makes
+		 * `TRandom3` seed from the clock.
+		 */
+		static unsigned int
+		toySeed ( unsigned int seed, unsigned int t ) {
+			unsigned long long z = ( (unsigned long long) seed << 32 ) + t + 0x9e3779b97f4a7c15ULL;
+			z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+			z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+			z ^= z >> 31;
+			return (unsigned int) z | 1;
+		}
+
+		/** @brief (Re)create the empty final histograms. */
+		void
+		book () {
+			for ( unsigned int k = 0; k < pull_.size(); ++ k )
+				delete pull_[k];
+			pull_.assign( truePars_.size(), (TH1D *) 0 );
+
+			for ( unsigned int k = 0; k < pull_.size(); ++ k ) {
+				pull_[k] = new TH1D( name_ + "Pull" + TString::Itoa( k, 10 ),
+						"Pulls for p_{" + TString::Itoa( k, 10 ) + "};( #hat{p} - p ) / #sigma_{#hat{p}};",
+						pullBins_, pullMin_, pullMax_ );
+			}
+
+			delete chiSquare_;
+			chiSquare_ = new TH1D( name_ + "ChiSquare",
+					reduced_ ? "Reduced #chi^{2};#chi^{2}/n;" : "#chi^{2};#chi^{2};",
+					chiSquareBins_, chiSquareMin_, chiSquareMax_ );
+
+			delete prob_;
+			prob_ = new TH1D( name_ + "ChiSquareProb",
+					"#chi^{2}-probability;Prob( #chi^{2} > #chi^{2}_{obs} );",
+					probBins_, 0., 1. );
+		}
+
+		TString name_;
+		std::vector<double> truePars_;
+
+		unsigned int pullBins_;
+		double pullMin_, pullMax_;
+		unsigned int chiSquareBins_;
+		double chiSquareMin_, chiSquareMax_;
+		bool reduced_;
+		unsigned int probBins_;
+
+		std::vector<TH1D *> pull_;
+		TH1D *chiSquare_;
+		TH1D *prob_;
+
+		unsigned int toys_;
+		unsigned int failed_;
+		double time_;
+};
+
+#endif   /* ----- #ifndef toy_study_INC  ----- */